@@ -6,6 +6,8 @@
 #include "GMatrix.h"
 #include "GBitmap.h"
 #include "GColor.h"
+#include "gradient_lut.h"
+#include "raster_pipeline.h"
 #include <iostream>
 #include "GMath.h"
 #include <algorithm>
@@ -17,21 +19,15 @@ class CGradient : public GShader
 public:
     CGradient(GPoint p0, GPoint p1, const GColor colors[], int count, GShader::TileMode tm)
     {
+        fOpaque = true;
         for (int i = 0; i < count; i++)
         {
             fColors.push_back(colors[i]);
+            fOpaque = fOpaque && colors[i].a >= 1;
         }
         fCount = count;
-        if (p0.x() < p1.x())
-        {
-            fP0 = p0;
-            fP1 = p1;
-        }
-        else
-        {
-            fP0 = p1;
-            fP1 = p0;
-        }
+        fP0 = p0;
+        fP1 = p1;
 
         float p0x = fP0.x();
         float p0y = fP0.y();
@@ -44,9 +40,10 @@ public:
         fTm = tm;
     }
 
+    // opaque iff every stop is, since lerping between opaque colors stays opaque
     bool isOpaque() override
     {
-        return false;
+        return fOpaque;
     }
 
     bool setContext(const GMatrix &ctm) override
@@ -54,77 +51,56 @@ public:
         // updates fCTM, returns false if it's not invertible
         this->fCTM = ctm;
         // took this line from MR's code, mults & inverts the mxs both for bool return and future shadeRow use
-        return (ctm * fLM).invert(&fInv);
+        if (!(ctm * fLM).invert(&fInv))
+        {
+            return false;
+        }
+
+        // size the color table from how long the gradient ends up on the device
+        float dx = fP1.x() - fP0.x();
+        float dy = fP1.y() - fP0.y();
+        float len = std::hypot(ctm[GMatrix::SX] * dx + ctm[GMatrix::KX] * dy,
+                               ctm[GMatrix::KY] * dx + ctm[GMatrix::SY] * dy);
+        int size = GradientLUT::SizeFor(len);
+        if (!fLUT || fLUT->size() != size)
+        {
+            fLUT = GradientLUT::Get(fColors.data(), fCount, size);
+        }
+        return true;
+    }
+
+    // the float version of shadeRow: lerp the stops themselves instead of reading the table
+    bool appendStages(RasterPipeline *p) override
+    {
+        fStops.fColors = fColors.data();
+        fStops.fCount = fCount;
+        p->append(stage_matrix, &fInv);
+        p->append(unit_tile_stage(fTm));
+        p->append(stage_evenly_spaced_stops, &fStops);
+        p->append(stage_premul);
+        return true;
+    }
+
+    // the color table is shared and never changes, so a plain copy will do
+    std::unique_ptr<GShader> clone() const override
+    {
+        return std::unique_ptr<GShader>(new CGradient(*this));
     }
 
     // for a given row, find the color on the gradient at that pixel
     void shadeRow(int x, int y, int count, GPixel row[]) override
     {
-        GMatrix *invptr = &fInv;
-        // transform, floor, pin, locate
-        // create a point for the current pixel center
-        GPoint rowpt = {(x + 0.5), (y + 0.5)};
-        GPoint mappedpt;
-        // run that point thru the inv mx
-        invptr->mapPoints(&mappedpt, &rowpt, 1);
-        float mX = mappedpt.fX;
-        // loop count (the row)
-        for (int i = 0; i < count; i++)
+        switch (fTm)
         {
-            float ix, fx;
-            // clamp in (0, 1) space
-            if (fTm == GShader::TileMode::kClamp)
-            {
-                // clamp the resulting x and y
-                ix = std::min(std::max(mX, 0.0f), 1.0f);
-            }
-            else if (fTm == GShader::TileMode::kMirror)
-            {
-                // get into 0,1 space
-                ix = mX;
-                ix *= 0.5;
-
-                ix = ix - floor(ix);
-               
-                ix > 0.5 ? ix = 1 - ix : ix = ix;
-                ix *= 2;
-            }
-            else if (fTm == GShader::TileMode::kRepeat)
-            { // get into 0,1 coordinates
-                ix = mX;
-                ix = ix - GFloorToInt(ix);
-            }
-
-            fx = ix * (fCount - 1);
-
-
-            // float ix = std::min(std::max(mX, 0.0f), 1.0f);
-
-            // find color at the current loc and make it a pixel, store it in row[]
-            GColor mC;
-            // first color will be current index and next will be next idx
-
-            // first, find origin pt on line
-            int idx = GFloorToInt(fx);
-
-            // then, find the colors that correspond
-            GColor c0 = fColors[idx];
-            GColor c1 = fColors[idx + 1];
-
-            // compute the ratio'd location in (0, 1) space
-            float w = fx - idx;
-
-            // finally, make color and store
-            mC = {
-                c0.r + (w * (c1.r - c0.r)),
-                c0.g + (w * (c1.g - c0.g)),
-                c0.b + (w * (c1.b - c0.b)),
-                c0.a + (w * (c1.a - c0.a))};
-
-            row[i] = colorToPixel(mC);
-            
-            // only incrementing x by a
-            mX = fInv[0] + mX;
+        case GShader::kClamp:
+            this->shade<GShader::kClamp>(x, y, count, row);
+            break;
+        case GShader::kRepeat:
+            this->shade<GShader::kRepeat>(x, y, count, row);
+            break;
+        case GShader::kMirror:
+            this->shade<GShader::kMirror>(x, y, count, row);
+            break;
         }
     }
 
@@ -136,19 +112,50 @@ private:
     GPoint fP0;
     GPoint fP1;
     int fCount;
+    bool fOpaque;
     GShader::TileMode fTm;
+    std::shared_ptr<const GradientLUT> fLUT;
+    GradientStopsCtx fStops;
 
-    GPixel colorToPixel(GColor color)
+    // t (how far along the gradient the pixel center is) only depends on x and y through
+    // the first row of fInv, so along a row it steps by fInv[SX]
+    template <GShader::TileMode TM>
+    void shade(int x, int y, int count, GPixel row[])
     {
-        float a = color.a * 255;
-        float r = color.r * color.a * 255;
-        float g = color.g * color.a * 255;
-        float b = color.b * color.a * 255;
-        return GPixel_PackARGB(a, r, g, b);
+        const GPixel *lut = fLUT->pixels();
+        const int size = fLUT->size();
+
+        float t = fInv[GMatrix::SX] * (x + 0.5f) + fInv[GMatrix::KX] * (y + 0.5f) + fInv[GMatrix::TX];
+        float dt = fInv[GMatrix::SX];
+
+        // 32.32 fixed point, as long as both ends of the row fit (else fall back to floats)
+        const float end = t + dt * count;
+        const float kFixedLimit = 1 << 30;
+        if (std::abs(t) < kFixedLimit && std::abs(end) < kFixedLimit)
+        {
+            int64_t ft = (int64_t)(t * kGradientOne);
+            int64_t fdt = (int64_t)(dt * kGradientOne);
+            for (int i = 0; i < count; i++)
+            {
+                row[i] = lut[gradient_index(tile_gradient<TM>(ft), size)];
+                ft += fdt;
+            }
+            return;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            float pinned = std::min(std::max(t, -kFixedLimit), kFixedLimit);
+            row[i] = lut[gradient_index(tile_gradient<TM>((int64_t)(pinned * kGradientOne)), size)];
+            t += dt;
+        }
     }
 };
 
 std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p1, const GColor colors[], int count, GShader::TileMode tm)
 {
-    return std::unique_ptr<GShader>(new CGradient(p1, p0, colors, count, tm));
-}
\ No newline at end of file
+    if (count < 1)
+    {
+        return nullptr;
+    }
+    return std::unique_ptr<GShader>(new CGradient(p0, p1, colors, count, tm));
+}
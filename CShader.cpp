@@ -5,16 +5,103 @@
 #include "GShader.h"
 #include "GMatrix.h"
 #include "GBitmap.h"
+#include "raster_pipeline.h"
 #include <iostream>
 #include "GMath.h"
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <stack>
 
+// true if n is a power of two, so tiling can use a mask instead of a divide
+static inline bool is_pow2(int n)
+{
+    return (n & (n - 1)) == 0;
+}
+
+/**
+ *  Tiles an integer src coordinate into [0, n). mask is n - 1 when n is a power of two (and
+ *  then both repeat and mirror reduce to ands), otherwise it's 0.
+ */
+template <GShader::TileMode TM>
+static inline int tile(int i, int n, int mask)
+{
+    if (TM == GShader::kClamp)
+    {
+        return std::min(std::max(i, 0), n - 1);
+    }
+    if (TM == GShader::kRepeat)
+    {
+        if (mask)
+        {
+            return i & mask;
+        }
+        i %= n;
+        return i < 0 ? i + n : i;
+    }
+    // mirror: the period is 2n, and the second half runs backwards
+    if (mask)
+    {
+        i &= 2 * mask + 1;
+    }
+    else
+    {
+        i %= 2 * n;
+        i = i < 0 ? i + 2 * n : i;
+    }
+    return i < n ? i : 2 * n - 1 - i;
+}
+
+// floor a src coordinate to an int, pinned far enough out that the conversion can't overflow
+// (out there the tile modes have long since stopped caring about the exact value)
+static inline int floor_pinned(float v)
+{
+    return pipeline_floor_int(v);
+}
+
+// average 2x2 premul pixels, rounding. the two channels in each half of the pixel get their own
+// 16 bit lane, so a pair of adds and shifts averages all four channels at once
+static inline GPixel average4(GPixel a, GPixel b, GPixel c, GPixel d)
+{
+    const uint32_t mask = 0x00FF00FF;
+    uint32_t rb = (a & mask) + (b & mask) + (c & mask) + (d & mask) + 0x00020002;
+    uint32_t ag = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + 0x00020002;
+    return ((rb >> 2) & mask) | (((ag >> 2) & mask) << 8);
+}
+
+// box filter src down to half its size (rounding odd sizes down, and repeating the last
+// row/column to fill out the box)
+static void downsample(const GBitmap &src, GPixel dst[], int dstW, int dstH)
+{
+    for (int y = 0; y < dstH; y++)
+    {
+        const GPixel *row0 = src.getAddr(0, 2 * y);
+        const GPixel *row1 = src.getAddr(0, std::min(2 * y + 1, src.height() - 1));
+        for (int x = 0; x < dstW; x++)
+        {
+            int x0 = 2 * x;
+            int x1 = std::min(2 * x + 1, src.width() - 1);
+            dst[x] = average4(row0[x0], row0[x1], row1[x0], row1[x1]);
+        }
+        dst += dstW;
+    }
+}
+
+// lerp each channel of a and b by t (0...256), in 8.8 fixed point
+static inline GPixel lerp8(GPixel a, GPixel b, unsigned t)
+{
+    const uint32_t mask = 0x00FF00FF;
+    uint32_t rb = ((a & mask) * (256 - t) + (b & mask) * t + 0x00800080) >> 8;
+    uint32_t ag = ((a >> 8) & mask) * (256 - t) + ((b >> 8) & mask) * t + 0x00800080;
+    return (rb & mask) | (ag & ~mask);
+}
+
 class CShader : public GShader
 {
 public:
-    CShader(const GBitmap &bm, const GMatrix &lm, GShader::TileMode tm) : fBM(bm), fLM(lm), fTm(tm){};
+    CShader(const GBitmap &bm, const GMatrix &lm, GShader::TileMode tm, GShader::Sampling sampling)
+        : fBM(bm), fLM(lm), fTm(tm), fSampling(sampling) {}
 
     bool isOpaque() override
     {
@@ -26,7 +113,50 @@ public:
         // updates fCTM, returns false if it's not invertible
         this->fCTM = ctm;
         // took this line from MR's code, mults & inverts the mxs both for bool return and future shadeRow use
-        return (ctm * fLM).invert(&fInv);
+        if (!(ctm * fLM).invert(&fInv))
+        {
+            return false;
+        }
+
+        // the canvas calls this once per draw, so pick the level to read from here: a minified
+        // draw reads from the pyramid level closest to its scale (and so touches far fewer
+        // pixels) and fInv is rescaled to that level's size
+        fSrc = &fBM;
+        if (fSampling == GShader::kMipmap)
+        {
+            int level = this->chooseLevel();
+            if (level > 0)
+            {
+                fSrc = &fPyramid->fLevels[level - 1];
+                fInv = GMatrix::Scale((float)fSrc->width() / fBM.width(),
+                                      (float)fSrc->height() / fBM.height()) *
+                       fInv;
+            }
+        }
+        fMaskX = is_pow2(fSrc->width()) ? fSrc->width() - 1 : 0;
+        fMaskY = is_pow2(fSrc->height()) ? fSrc->height() - 1 : 0;
+
+        // and pick the cheapest way to walk a row.
+        // without skew, a row of device pixels maps to a row of src pixels
+        if (fInv[GMatrix::KX] != 0 || fInv[GMatrix::KY] != 0)
+        {
+            fKind = kAffine;
+        }
+        else if (fInv[GMatrix::SX] == 1 && fInv[GMatrix::SY] == 1)
+        {
+            fKind = kTranslate;
+        }
+        else
+        {
+            fKind = kScaleTranslate;
+        }
+        return true;
+    }
+
+    // the pyramid is shared, and setContext() points fSrc at the clone's own fBM again
+    std::unique_ptr<GShader> clone() const override
+    {
+        return std::unique_ptr<GShader>(new CShader(*this));
     }
 
     /**
@@ -36,75 +166,317 @@ public:
      */
     void shadeRow(int x, int y, int count, GPixel row[]) override
     {
-        GMatrix *invptr = &fInv;
+        if (fSampling == GShader::kNearest)
+        {
+            switch (fTm)
+            {
+            case GShader::kClamp:
+                this->shade<GShader::kClamp>(x, y, count, row);
+                break;
+            case GShader::kRepeat:
+                this->shade<GShader::kRepeat>(x, y, count, row);
+                break;
+            case GShader::kMirror:
+                this->shade<GShader::kMirror>(x, y, count, row);
+                break;
+            }
+            return;
+        }
+        switch (fTm)
+        {
+        case GShader::kClamp:
+            this->shadeLinear<GShader::kClamp>(x, y, count, row);
+            break;
+        case GShader::kRepeat:
+            this->shadeLinear<GShader::kRepeat>(x, y, count, row);
+            break;
+        case GShader::kMirror:
+            this->shadeLinear<GShader::kMirror>(x, y, count, row);
+            break;
+        }
+    }
 
-        // loop count
-        for (int i = 0; i < count; i++)
+    // the float version of shadeRow: map the pixel centers, then sample at the level
+    // setContext picked
+    bool appendStages(RasterPipeline *p) override
+    {
+        p->append(stage_matrix, &fInv);
+        bool linear = fSampling != GShader::kNearest;
+        switch (fTm)
         {
-            // transform, floor, pin, locate
-            // crerate a point for the current pixel center
-            GPoint rowpt = {(x + i + 0.5), (y + 0.5)};
-            GPoint mappedpt;
-            // run that point thru the inv mx
-            invptr->mapPoints(&mappedpt, &rowpt, 1);
-            float widthFract = 1.0f / fBM.width();
-            float heightFract = 1.0f / fBM.height();
-
-            // floor the resulting x and y
-            int ix, iy;
-            // ix = mappedpt.fX/fBM.width();
-            // iy = mappedpt.fY/fBM.height();
-
-            // get into 0,1 space
-            float fix = mappedpt.fX * widthFract;
-            float fiy = mappedpt.fY * heightFract;
-
-            if (fTm == GShader::TileMode::kClamp)
+        case GShader::kClamp:
+            p->append(linear ? stage_bilinear<GShader::kClamp> : stage_nearest<GShader::kClamp>, this);
+            break;
+        case GShader::kRepeat:
+            p->append(linear ? stage_bilinear<GShader::kRepeat> : stage_nearest<GShader::kRepeat>, this);
+            break;
+        case GShader::kMirror:
+            p->append(linear ? stage_bilinear<GShader::kMirror> : stage_nearest<GShader::kMirror>, this);
+            break;
+        }
+        return true;
+    }
+
+private:
+    enum Kind
+    {
+        kTranslate,      // src = device + (tx, ty)
+        kScaleTranslate, // src = device * (sx, sy) + (tx, ty)
+        kAffine,         // anything with skew (or rotation)
+    };
+
+    // the pyramid level for this draw's scale (0 is fBM itself): the deepest level that
+    // still has at least one src pixel per device pixel. builds the pyramid the first time
+    int chooseLevel()
+    {
+        // src pixels per device pixel, along the device axis that shrinks the most
+        float sx = std::sqrt(fInv[GMatrix::SX] * fInv[GMatrix::SX] + fInv[GMatrix::KY] * fInv[GMatrix::KY]);
+        float sy = std::sqrt(fInv[GMatrix::KX] * fInv[GMatrix::KX] + fInv[GMatrix::SY] * fInv[GMatrix::SY]);
+        float scale = std::max(sx, sy);
+        if (!(scale >= 2))
+        {
+            return 0;
+        }
+        this->buildPyramid();
+        int level = std::min(GFloorToInt(std::log2(scale)), (int)fPyramid->fLevels.size());
+        return std::max(level, 0);
+    }
+
+    // each level is half the size of the one before, down to 1x1
+    void buildPyramid()
+    {
+        Pyramid &pyramid = *fPyramid;
+        std::call_once(pyramid.fOnce, [this, &pyramid]
+                       {
+            // count and size the levels first, so the storage never moves once views point into it
+            std::vector<GISize> sizes;
+            size_t total = 0;
+            for (int w = fBM.width(), h = fBM.height(); w > 1 || h > 1;)
             {
-                // clamp the resulting x and y
-                fix = std::min(std::max(fix, 0.0f), 1.0f);
-                fiy = std::min(std::max(fiy, 0.0f), 1.0f);
+                w = std::max(w / 2, 1);
+                h = std::max(h / 2, 1);
+                sizes.push_back({w, h});
+                total += (size_t)w * h;
             }
-            else if (fTm == GShader::TileMode::kMirror)
+            pyramid.fPixels.resize(total);
+
+            GPixel *pixels = pyramid.fPixels.data();
+            const GBitmap *prev = &fBM;
+            pyramid.fLevels.reserve(sizes.size());
+            for (GISize size : sizes)
+            {
+                downsample(*prev, pixels, size.width(), size.height());
+                pyramid.fLevels.push_back(GBitmap(size.width(), size.height(), size.width() * sizeof(GPixel),
+                                                  pixels, fBM.isOpaque()));
+                prev = &pyramid.fLevels.back();
+                pixels += (size_t)size.width() * size.height();
+            } });
+    }
+
+    template <GShader::TileMode TM>
+    void shade(int x, int y, int count, GPixel row[])
+    {
+        const GBitmap &bm = *fSrc;
+        const int w = bm.width();
+        const int h = bm.height();
+
+        // the center of the first pixel, in src space
+        GPoint p = {x + 0.5f, y + 0.5f};
+        fInv.mapPoints(&p, &p, 1);
+
+        if (fKind == kAffine)
+        {
+            // step along the row by the inverse's x derivatives instead of mapping every pixel
+            const float dx = fInv[GMatrix::SX];
+            const float dy = fInv[GMatrix::KY];
+            for (int i = 0; i < count; i++)
             {
-                fix *= 0.5;
-                fiy *= 0.5;
+                int ix = tile<TM>(floor_pinned(p.fX), w, fMaskX);
+                int iy = tile<TM>(floor_pinned(p.fY), h, fMaskY);
+                row[i] = *bm.getAddr(ix, iy);
+                p.fX += dx;
+                p.fY += dy;
+            }
+            return;
+        }
 
-                fix -= floor(fix);
-                fiy -= floor(fiy);
+        // no skew: the whole row reads from one src row
+        const GPixel *src = bm.getAddr(0, tile<TM>(floor_pinned(p.fY), h, fMaskY));
 
-                fix > 0.5 ? fix = 1.0f - fix : fix = fix;
-                fiy > 0.5 ? fiy = 1.0f - fiy : fiy = fiy;
-                fix *= 2;
-                fiy *= 2;
+        if (fKind == kTranslate)
+        {
+            // whole src pixels, stepping by one
+            int ix = floor_pinned(p.fX);
+            for (int i = 0; i < count; i++)
+            {
+                row[i] = src[tile<TM>(ix + i, w, fMaskX)];
             }
-            else if (fTm == GShader::TileMode::kRepeat)
-            { 
-                fix = fix - GFloorToInt(fix);
-                fiy = fiy - GFloorToInt(fiy);
+            return;
+        }
+
+        // 16.16 fixed point, as long as both ends of the row fit (else fall back to floats)
+        const float dx = fInv[GMatrix::SX];
+        const float end = p.fX + dx * count;
+        const float kFixedLimit = 1 << 14;
+        if (std::abs(p.fX) < kFixedLimit && std::abs(end) < kFixedLimit)
+        {
+            int fx = (int)(p.fX * 65536);
+            int fdx = (int)(dx * 65536);
+            for (int i = 0; i < count; i++)
+            {
+                row[i] = src[tile<TM>(fx >> 16, w, fMaskX)];
+                fx += fdx;
+            }
+            return;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            row[i] = src[tile<TM>(floor_pinned(p.fX), w, fMaskX)];
+            p.fX += dx;
+        }
+    }
+
+    // blends the 4 src pixels around each sample point. the sample point is offset by half a
+    // pixel so that whole weights land on pixel centers, and both neighbors are tiled on their
+    // own, so repeat and mirror blend across the seams
+    template <GShader::TileMode TM>
+    void shadeLinear(int x, int y, int count, GPixel row[])
+    {
+        const GBitmap &bm = *fSrc;
+        const int w = bm.width();
+        const int h = bm.height();
+
+        GPoint p = {x + 0.5f, y + 0.5f};
+        fInv.mapPoints(&p, &p, 1);
+        p.fX -= 0.5f;
+        p.fY -= 0.5f;
+        const float dx = fInv[GMatrix::SX];
+        const float dy = fInv[GMatrix::KY];
+
+        // no skew: the two src rows and the y weight are the same for the whole row, and x can
+        // step in 16.16 fixed point (as long as both ends of the row fit)
+        const float end = p.fX + dx * count;
+        const float kFixedLimit = 1 << 14;
+        if (fKind != kAffine && std::abs(p.fX) < kFixedLimit && std::abs(end) < kFixedLimit)
+        {
+            int y0 = floor_pinned(p.fY);
+            unsigned ty = (unsigned)((p.fY - y0) * 256 + 0.5f);
+            const GPixel *row0 = bm.getAddr(0, tile<TM>(y0, h, fMaskY));
+            const GPixel *row1 = bm.getAddr(0, tile<TM>(y0 + 1, h, fMaskY));
+
+            int fx = (int)std::floor(p.fX * 65536 + 0.5f);
+            int fdx = (int)std::floor(dx * 65536 + 0.5f);
+            for (int i = 0; i < count; i++)
+            {
+                int x0 = fx >> 16;
+                unsigned tx = ((fx & 0xFFFF) + 0x80) >> 8;
+                int ix0 = tile<TM>(x0, w, fMaskX);
+                int ix1 = tile<TM>(x0 + 1, w, fMaskX);
+                row[i] = lerp8(lerp8(row0[ix0], row0[ix1], tx), lerp8(row1[ix0], row1[ix1], tx), ty);
+                fx += fdx;
             }
-            // return to bitmap coords
-            ix = GFloorToInt(fix * (fBM.width() - 1));
-            iy = GFloorToInt(fiy * (fBM.height() - 1));
-            ix = std::min(std::max(ix, 0), fBM.width());
-            iy = std::min(std::max(iy, 0), fBM.height());
+            return;
+        }
 
-            // get pixel at original space's x and y
+        for (int i = 0; i < count; i++)
+        {
+            int x0 = floor_pinned(p.fX);
+            int y0 = floor_pinned(p.fY);
+            unsigned tx = (unsigned)((p.fX - x0) * 256 + 0.5f);
+            unsigned ty = (unsigned)((p.fY - y0) * 256 + 0.5f);
+            int ix0 = tile<TM>(x0, w, fMaskX);
+            int ix1 = tile<TM>(x0 + 1, w, fMaskX);
+            const GPixel *row0 = bm.getAddr(0, tile<TM>(y0, h, fMaskY));
+            const GPixel *row1 = bm.getAddr(0, tile<TM>(y0 + 1, h, fMaskY));
 
-            row[i] = *fBM.getAddr(ix, iy);
-            
+            row[i] = lerp8(lerp8(row0[ix0], row0[ix1], tx), lerp8(row1[ix0], row1[ix1], tx), ty);
+            p.fX += dx;
+            p.fY += dy;
+        }
+    }
+
+    // ctx is the CShader
+    template <GShader::TileMode TM>
+    static void stage_nearest(PipelineLanes &p, const void *ctx)
+    {
+        const CShader &shader = *static_cast<const CShader *>(ctx);
+        const GBitmap &bm = *shader.fSrc;
+        const GPixel *pixels = bm.pixels();
+        const int stride = (int)(bm.rowBytes() >> 2);
+
+        // indices, gather, unpack: the first and last loops vectorize
+        int index[kPipelineLanes];
+        for (int i = 0; i < kPipelineLanes; i++)
+        {
+            int ix = tile<TM>(floor_pinned(p.x[i]), bm.width(), shader.fMaskX);
+            int iy = tile<TM>(floor_pinned(p.y[i]), bm.height(), shader.fMaskY);
+            index[i] = iy * stride + ix;
+        }
+        GPixel px[kPipelineLanes];
+        for (int i = 0; i < kPipelineLanes; i++)
+        {
+            px[i] = pixels[index[i]];
+        }
+        pipeline_unpack_lanes(px, p.r, p.g, p.b, p.a);
+    }
+
+    template <GShader::TileMode TM>
+    static void stage_bilinear(PipelineLanes &p, const void *ctx)
+    {
+        const CShader &shader = *static_cast<const CShader *>(ctx);
+        const GBitmap &bm = *shader.fSrc;
+        float r[4], g[4], b[4], a[4];
+        for (int i = 0; i < kPipelineLanes; i++)
+        {
+            float x = p.x[i] - 0.5f;
+            float y = p.y[i] - 0.5f;
+            int x0 = floor_pinned(x);
+            int y0 = floor_pinned(y);
+            float tx = x - x0;
+            float ty = y - y0;
+            int ix0 = tile<TM>(x0, bm.width(), shader.fMaskX);
+            int ix1 = tile<TM>(x0 + 1, bm.width(), shader.fMaskX);
+            int iy0 = tile<TM>(y0, bm.height(), shader.fMaskY);
+            int iy1 = tile<TM>(y0 + 1, bm.height(), shader.fMaskY);
+            pipeline_unpack(*bm.getAddr(ix0, iy0), 0, r, g, b, a);
+            pipeline_unpack(*bm.getAddr(ix1, iy0), 1, r, g, b, a);
+            pipeline_unpack(*bm.getAddr(ix0, iy1), 2, r, g, b, a);
+            pipeline_unpack(*bm.getAddr(ix1, iy1), 3, r, g, b, a);
+
+            float w[4] = {(1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty};
+            p.r[i] = r[0] * w[0] + r[1] * w[1] + r[2] * w[2] + r[3] * w[3];
+            p.g[i] = g[0] * w[0] + g[1] * w[1] + g[2] * w[2] + g[3] * w[3];
+            p.b[i] = b[0] * w[0] + b[1] * w[1] + b[2] * w[2] + b[3] * w[3];
+            p.a[i] = a[0] * w[0] + a[1] * w[1] + a[2] * w[2] + a[3] * w[3];
         }
     }
 
-private:
     GBitmap fBM;
     GMatrix fLM;
     GMatrix fInv;
     GMatrix fCTM;
     GShader::TileMode fTm;
+    GShader::Sampling fSampling;
+    Kind fKind = kAffine;
+
+    // what this draw reads from: fBM, or one of the pyramid's levels
+    const GBitmap *fSrc = &fBM;
+    int fMaskX = 0;
+    int fMaskY = 0;
+
+    // the mip pyramid (fBM / 2, fBM / 4, ... 1x1), built by the first minified draw. clones
+    // share it, so it is built once however many threads draw with them
+    struct Pyramid
+    {
+        std::once_flag fOnce;
+        std::vector<GPixel> fPixels;
+        std::vector<GBitmap> fLevels;
+    };
+    std::shared_ptr<Pyramid> fPyramid = std::make_shared<Pyramid>();
 };
 
-std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap &bm, const GMatrix &localMatrix, GShader::TileMode tm)
+std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap &bm, const GMatrix &localMatrix, GShader::TileMode tm,
+                                             GShader::Sampling sampling)
 {
-    return std::unique_ptr<GShader>(new CShader(bm, localMatrix, tm));
+    return std::unique_ptr<GShader>(new CShader(bm, localMatrix, tm, sampling));
 }
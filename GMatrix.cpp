@@ -80,6 +80,19 @@ bool GMatrix::invert(GMatrix *inverse) const
  */
 void GMatrix::mapPoints(GPoint dst[], const GPoint src[], int count) const
 {
+    if (this->fMat[KX] == 0 && this->fMat[KY] == 0)
+    {
+        // scale/translate (the common case): x and y don't mix, which is a loop the compiler
+        // vectorizes. same results as below for any finite point
+        const float sx = this->fMat[SX], tx = this->fMat[TX];
+        const float sy = this->fMat[SY], ty = this->fMat[TY];
+        for (int i = 0; i < count; i++)
+        {
+            dst[i].fX = sx * src[i].fX + tx;
+            dst[i].fY = sy * src[i].fY + ty;
+        }
+        return;
+    }
     for (int i = 0; i < count; i++)
     {
         float srcx = src[i].fX;
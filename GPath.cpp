@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include <vector>
 #include <stack>
 #include "GPath.h"
@@ -224,25 +225,178 @@ GPath &GPath::addPolygon(const GPoint pts[], int count)
 
 GRect GPath::bounds() const
 {
-    float L = 1000;
-    float R = 0;
-    float T = 1000;
-    float B = 0;
     if (this->countPoints() == 0)
     {
         return GRect::LTRB(0, 0, 0, 0);
     }
-    for (GPoint p : this->fPts)
+    Data &data = *fData;
+    if (data.fBoundsState.load(std::memory_order_acquire) == Data::kBoundsReady)
     {
-        L = std::min(L, p.fX);
-        R = std::max(R, p.fX);
-        T = std::min(T, p.fY);
-        B = std::max(B, p.fY);
+        return data.fBounds;
     }
-    return GRect::LTRB(L, T, R, B);
-};
+
+    // seeded with the first point, so any coordinates work
+    GRect r = GRect::LTRB(data.fPts[0].fX, data.fPts[0].fY, data.fPts[0].fX, data.fPts[0].fY);
+    for (GPoint p : data.fPts)
+    {
+        r.fLeft = std::min(r.fLeft, p.fX);
+        r.fRight = std::max(r.fRight, p.fX);
+        r.fTop = std::min(r.fTop, p.fY);
+        r.fBottom = std::max(r.fBottom, p.fY);
+    }
+    int state = Data::kBoundsUnknown;
+    if (data.fBoundsState.compare_exchange_strong(state, Data::kBoundsStoring, std::memory_order_acquire))
+    {
+        data.fBounds = r;
+        data.fBoundsState.store(Data::kBoundsReady, std::memory_order_release);
+    }
+    return r;
+}
+
+// the t's in (0, 1) where a + b*t (one coordinate of a quad's derivative, over 2) is 0
+static int quad_extrema(float a, float b, float ts[1])
+{
+    if (b == 0)
+    {
+        return 0;
+    }
+    float t = -a / b;
+    ts[0] = t;
+    return t > 0 && t < 1 ? 1 : 0;
+}
+
+// the t's in (0, 1) where a*t^2 + b*t + c (one coordinate of a cubic's derivative, over 3)
+// is 0
+static int cubic_extrema(float a, float b, float c, float ts[2])
+{
+    if (a == 0)
+    {
+        return quad_extrema(c, b, ts);
+    }
+    double disc = (double)b * b - 4.0 * a * c;
+    if (disc < 0)
+    {
+        return 0;
+    }
+    double root = std::sqrt(disc);
+    int n = 0;
+    for (double t : {(-b - root) / (2.0 * a), (-b + root) / (2.0 * a)})
+    {
+        if (t > 0 && t < 1)
+        {
+            ts[n++] = (float)t;
+        }
+    }
+    return n;
+}
+
+static GPoint eval_quad(const GPoint p[3], float t)
+{
+    float s = 1 - t;
+    return {s * s * p[0].fX + 2 * s * t * p[1].fX + t * t * p[2].fX,
+            s * s * p[0].fY + 2 * s * t * p[1].fY + t * t * p[2].fY};
+}
+
+static GPoint eval_cubic(const GPoint p[4], float t)
+{
+    float s = 1 - t;
+    float a = s * s * s, b = 3 * s * s * t, c = 3 * s * t * t, d = t * t * t;
+    return {a * p[0].fX + b * p[1].fX + c * p[2].fX + d * p[3].fX,
+            a * p[0].fY + b * p[1].fY + c * p[2].fY + d * p[3].fY};
+}
+
+GRect GPath::computeTightBounds() const
+{
+    if (this->countPoints() == 0)
+    {
+        return GRect::LTRB(0, 0, 0, 0);
+    }
+    const GPoint &first = this->data().fPts[0];
+    GRect r = GRect::LTRB(first.fX, first.fY, first.fX, first.fY);
+    auto add = [&](GPoint p)
+    {
+        r.fLeft = std::min(r.fLeft, p.fX);
+        r.fRight = std::max(r.fRight, p.fX);
+        r.fTop = std::min(r.fTop, p.fY);
+        r.fBottom = std::max(r.fBottom, p.fY);
+    };
+
+    // the ends of every segment, plus wherever a curve turns back in x or in y
+    Iter iter(*this);
+    GPoint pts[kMaxNextPoints];
+    Verb v;
+    float ts[2];
+    while ((v = iter.next(pts)) != kDone)
+    {
+        switch (v)
+        {
+        case kMove:
+            add(pts[0]);
+            break;
+        case kLine:
+            add(pts[1]);
+            break;
+        case kQuad:
+            add(pts[2]);
+            for (int i = quad_extrema(pts[1].fX - pts[0].fX, pts[0].fX - 2 * pts[1].fX + pts[2].fX, ts); i-- > 0;)
+            {
+                add(eval_quad(pts, ts[i]));
+            }
+            for (int i = quad_extrema(pts[1].fY - pts[0].fY, pts[0].fY - 2 * pts[1].fY + pts[2].fY, ts); i-- > 0;)
+            {
+                add(eval_quad(pts, ts[i]));
+            }
+            break;
+        case kCubic:
+        {
+            add(pts[3]);
+            auto extrema = [&](float p0, float p1, float p2, float p3)
+            {
+                return cubic_extrema(p3 - 3 * p2 + 3 * p1 - p0, 2 * (p2 - 2 * p1 + p0), p1 - p0, ts);
+            };
+            for (int i = extrema(pts[0].fX, pts[1].fX, pts[2].fX, pts[3].fX); i-- > 0;)
+            {
+                add(eval_cubic(pts, ts[i]));
+            }
+            for (int i = extrema(pts[0].fY, pts[1].fY, pts[2].fY, pts[3].fY); i-- > 0;)
+            {
+                add(eval_cubic(pts, ts[i]));
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return r;
+}
 
 void GPath::transform(const GMatrix &m)
 {
-    m.mapPoints(&(this->fPts[0]), &(this->fPts[0]), this->countPoints());
+    if (this->countPoints() == 0)
+    {
+        return;
+    }
+    // edit() gives us our own copy first if the points are shared
+    Data &data = this->edit();
+    m.mapPoints(data.fPts.data(), data.fPts.data(), this->countPoints());
+}
+
+void GPath::transform(const GMatrix &m, GPath *dst) const
+{
+    if (dst == this)
+    {
+        dst->transform(m);
+        return;
+    }
+    // no point copying dst's old (shared) contents just to overwrite them
+    if (dst->fData.use_count() > 1)
+    {
+        dst->fData = nullptr;
+    }
+    const Data &src = this->data();
+    Data &out = dst->edit();
+    out.fVbs.assign(src.fVbs.begin(), src.fVbs.end());
+    out.fPts.resize(src.fPts.size());
+    m.mapPoints(out.fPts.data(), src.fPts.data(), (int)src.fPts.size());
 }
@@ -0,0 +1,353 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#include "GPicture.h"
+#include "GMatrix.h"
+#include "GPaint.h"
+#include "GPath.h"
+#include "GPoint.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+/**
+ *  Buffer layout: a run of ops, each starting with an OpHeader whose fSize covers the whole
+ *  op (so culled draws are skipped without parsing them), and padded to 4 bytes.
+ *
+ *      kSave, kRestore     header
+ *      kConcat             header, GMatrix
+ *      kDrawPaint          header, GPaint
+ *      kDrawRect           header, bounds, GPaint, GRect
+ *      kDrawPolygon        header, bounds, GPaint, int count, GPoint[count]
+ *      kDrawPath           header, bounds, GPaint, int ptCount, int verbCount,
+ *                          GPoint[ptCount], uint8_t verbs[verbCount]
+ *
+ *  bounds is a GRect in the op's local coordinates (before the CTM).
+ */
+enum class PictureOp : uint32_t
+{
+    kSave,
+    kRestore,
+    kConcat,
+    kDrawPaint,
+    kDrawRect,
+    kDrawPolygon,
+    kDrawPath,
+};
+
+struct OpHeader
+{
+    PictureOp fOp;
+    uint32_t fSize;
+};
+
+static GRect bounds_of(const GPoint pts[], int count)
+{
+    GRect r = GRect::LTRB(pts[0].fX, pts[0].fY, pts[0].fX, pts[0].fY);
+    for (int i = 1; i < count; i++)
+    {
+        r.fLeft = std::min(r.fLeft, pts[i].fX);
+        r.fTop = std::min(r.fTop, pts[i].fY);
+        r.fRight = std::max(r.fRight, pts[i].fX);
+        r.fBottom = std::max(r.fBottom, pts[i].fY);
+    }
+    return r;
+}
+
+class RecordingCanvas : public GCanvas
+{
+public:
+    void save() override
+    {
+        this->begin(PictureOp::kSave);
+        this->end();
+        fSaveCount++;
+    }
+
+    void restore() override
+    {
+        if (fSaveCount == 0)
+        {
+            throw 505;
+        }
+        this->begin(PictureOp::kRestore);
+        this->end();
+        fSaveCount--;
+    }
+
+    void concat(const GMatrix &mx) override
+    {
+        this->begin(PictureOp::kConcat);
+        this->write(mx);
+        this->end();
+    }
+
+    void drawPaint(const GPaint &paint) override
+    {
+        this->begin(PictureOp::kDrawPaint);
+        this->write(paint);
+        this->end();
+    }
+
+    void drawRect(const GRect &rect, const GPaint &paint) override
+    {
+        this->begin(PictureOp::kDrawRect);
+        this->write(rect);
+        this->write(paint);
+        this->write(rect);
+        this->end();
+    }
+
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint &paint) override
+    {
+        if (count < 3)
+        {
+            return;
+        }
+        this->begin(PictureOp::kDrawPolygon);
+        this->write(bounds_of(pts, count));
+        this->write(paint);
+        this->write(count);
+        this->writeArray(pts, count);
+        this->end();
+    }
+
+    void drawPath(const GPath &path, const GPaint &paint) override
+    {
+        if (path.countPoints() < 3)
+        {
+            return;
+        }
+        // flatten the path back into the points and verbs it was built from
+        std::vector<GPoint> pts;
+        std::vector<uint8_t> verbs;
+        pts.reserve(path.countPoints());
+        GPath::Iter iter(path);
+        GPoint p[GPath::kMaxNextPoints];
+        GPath::Verb v;
+        while ((v = iter.next(p)) != GPath::kDone)
+        {
+            switch (v)
+            {
+            case GPath::kMove:
+                pts.push_back(p[0]);
+                break;
+            case GPath::kLine:
+                pts.push_back(p[1]);
+                break;
+            case GPath::kQuad:
+                pts.insert(pts.end(), p + 1, p + 3);
+                break;
+            case GPath::kCubic:
+                pts.insert(pts.end(), p + 1, p + 4);
+                break;
+            case GPath::kDone:
+                break;
+            }
+            verbs.push_back((uint8_t)v);
+        }
+
+        // control points contain the curves, so they make (slightly loose) bounds
+        this->begin(PictureOp::kDrawPath);
+        this->write(bounds_of(pts.data(), (int)pts.size()));
+        this->write(paint);
+        this->write((int)pts.size());
+        this->write((int)verbs.size());
+        this->writeArray(pts.data(), (int)pts.size());
+        this->writeArray(verbs.data(), (int)verbs.size());
+        this->end();
+    }
+
+    // closes any open saves, and hands over the buffer
+    std::vector<char> finish(int *opCount)
+    {
+        while (fSaveCount > 0)
+        {
+            this->restore();
+        }
+        *opCount = fOpCount;
+        return std::move(fData);
+    }
+
+private:
+    void begin(PictureOp op)
+    {
+        fOpStart = fData.size();
+        this->write(OpHeader{op, 0});
+    }
+
+    // pad to 4 bytes and patch the op's size into its header
+    void end()
+    {
+        fData.resize((fData.size() + 3) & ~(size_t)3);
+        uint32_t size = (uint32_t)(fData.size() - fOpStart);
+        memcpy(&fData[fOpStart + offsetof(OpHeader, fSize)], &size, sizeof(size));
+        fOpCount++;
+    }
+
+    template <typename T>
+    void write(const T &value)
+    {
+        this->writeArray(&value, 1);
+    }
+
+    template <typename T>
+    void writeArray(const T values[], int count)
+    {
+        const char *bytes = reinterpret_cast<const char *>(values);
+        fData.insert(fData.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    std::vector<char> fData;
+    size_t fOpStart = 0;
+    int fOpCount = 0;
+    int fSaveCount = 0;
+};
+
+// walks the buffer, copying values out (nothing in it is guaranteed to be aligned for T)
+class PictureReader
+{
+public:
+    PictureReader(const char *data) : fCurr(data) {}
+
+    template <typename T>
+    T read()
+    {
+        T value;
+        memcpy(&value, fCurr, sizeof(T));
+        fCurr += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    void readArray(T dst[], int count)
+    {
+        memcpy(dst, fCurr, count * sizeof(T));
+        fCurr += count * sizeof(T);
+    }
+
+private:
+    const char *fCurr;
+};
+
+void GPicture::playback(GCanvas *canvas) const
+{
+    std::vector<GPoint> pts;
+    std::vector<uint8_t> verbs;
+    // rebuilt for each path op, reusing its storage
+    GPath path;
+
+    // the recording's saves and restores are balanced, but a concat outside any save isn't
+    canvas->save();
+    const char *curr = fData.data();
+    const char *stop = curr + fData.size();
+    while (curr < stop)
+    {
+        PictureReader reader(curr);
+        OpHeader header = reader.read<OpHeader>();
+        curr += header.fSize;
+
+        switch (header.fOp)
+        {
+        case PictureOp::kSave:
+            canvas->save();
+            continue;
+        case PictureOp::kRestore:
+            canvas->restore();
+            continue;
+        case PictureOp::kConcat:
+            canvas->concat(reader.read<GMatrix>());
+            continue;
+        case PictureOp::kDrawPaint:
+            canvas->drawPaint(reader.read<GPaint>());
+            continue;
+        default:
+            break;
+        }
+
+        // the rest are draws with bounds
+        if (canvas->quickReject(reader.read<GRect>()))
+        {
+            continue;
+        }
+        GPaint paint = reader.read<GPaint>();
+        switch (header.fOp)
+        {
+        case PictureOp::kDrawRect:
+            canvas->drawRect(reader.read<GRect>(), paint);
+            break;
+        case PictureOp::kDrawPolygon:
+        {
+            int count = reader.read<int>();
+            pts.resize(count);
+            reader.readArray(pts.data(), count);
+            canvas->drawConvexPolygon(pts.data(), count, paint);
+            break;
+        }
+        case PictureOp::kDrawPath:
+        {
+            int ptCount = reader.read<int>();
+            int verbCount = reader.read<int>();
+            pts.resize(ptCount);
+            verbs.resize(verbCount);
+            reader.readArray(pts.data(), ptCount);
+            reader.readArray(verbs.data(), verbCount);
+
+            path.reset();
+            const GPoint *p = pts.data();
+            for (uint8_t v : verbs)
+            {
+                switch ((GPath::Verb)v)
+                {
+                case GPath::kMove:
+                    path.moveTo(p[0]);
+                    p += 1;
+                    break;
+                case GPath::kLine:
+                    path.lineTo(p[0]);
+                    p += 1;
+                    break;
+                case GPath::kQuad:
+                    path.quadTo(p[0], p[1]);
+                    p += 2;
+                    break;
+                case GPath::kCubic:
+                    path.cubicTo(p[0], p[1], p[2]);
+                    p += 3;
+                    break;
+                case GPath::kDone:
+                    break;
+                }
+            }
+            canvas->drawPath(path, paint);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    canvas->restore();
+}
+
+GPictureRecorder::GPictureRecorder() {}
+
+GPictureRecorder::~GPictureRecorder() {}
+
+GCanvas *GPictureRecorder::beginRecording()
+{
+    fCanvas.reset(new RecordingCanvas);
+    return fCanvas.get();
+}
+
+std::unique_ptr<GPicture> GPictureRecorder::finishRecording()
+{
+    if (!fCanvas)
+    {
+        return nullptr;
+    }
+    int opCount;
+    std::vector<char> data = static_cast<RecordingCanvas *>(fCanvas.get())->finish(&opCount);
+    fCanvas = nullptr;
+    return std::unique_ptr<GPicture>(new GPicture(std::move(data), opCount));
+}
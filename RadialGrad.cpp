@@ -2,129 +2,102 @@
 #include "GMatrix.h"
 #include "GBitmap.h"
 #include "GColor.h"
+#include "gradient_lut.h"
+#include "raster_pipeline.h"
 #include <iostream>
 #include "GMath.h"
 #include <algorithm>
 #include <vector>
 #include <stack>
 
+// the same test span_blit.h makes for SPAN_BLIT_SSE2 (that header is all blend kernels, so it
+// isn't included here)
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define RADIAL_GRAD_SSE2 1
+#endif
+
 class RadialGrad : public GShader
 {
 public:
     RadialGrad(GPoint center, const GColor colors[], int count, float radius, GShader::TileMode tm)
     {
+        fOpaque = true;
         for (int i = 0; i < count; i++)
         {
             fColors.push_back(colors[i]);
+            fOpaque = fOpaque && colors[i].a >= 1;
         }
         fCount = count;
         fCenter = center;
         fRadius = radius;
 
-        // Scale
-        fLM.Translate(fCenter.x(), fCenter.y());
+        // maps the unit circle onto the gradient's circle, so t is just the distance from 0
+        fLM = GMatrix::Translate(fCenter.x(), fCenter.y()) * GMatrix::Scale(fRadius, fRadius);
 
         fTm = tm;
     }
 
+    // opaque iff every stop is, since lerping between opaque colors stays opaque
     bool isOpaque() override
     {
-        return false;
+        return fOpaque;
     }
 
     bool setContext(const GMatrix &ctm) override
     {
         // updates fCTM, returns false if it's not invertible
         this->fCTM = ctm;
-        // took this line from MR's code, mults & inverts the mxs both for bool return and future shadeRow use
-        return (ctm * fLM).invert(&fInv);
-    }
-
-    // for a given row, find the color on the gradient at that pixel
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-        GMatrix *invptr = &fInv;
-        // transform, floor, pin, locate
-        // create a point for the current pixel center
-        GPoint rowpt = {(x + 0.5), (y + 0.5)};
-        GPoint mappedpt;
-        // run that point thru the inv mx
-        invptr->mapPoints(&mappedpt, &rowpt, 1);
-
-        float mX = mappedpt.fX;
-        float mY = mappedpt.fY;
-
-        float centerY = fCenter.y();
-        float centerX = fCenter.x();
-        float ydiff = abs(mY - centerY);
-        float ysquared = pow(ydiff, 2);
-        float xdiff = abs(mX - centerX);
-        // loop count (the row)
-        for (int i = 0; i < count; i++)
+        if (!(ctm * fLM).invert(&fInv))
         {
-            float xsquared = pow(xdiff, 2);
-            float l = sqrt(xsquared + ysquared);
-            float ratio = (float)l/(float)fRadius;
-
-            float ix, fx;
-
-            if (fTm == GShader::TileMode::kClamp)
-            {
-                // clamp the resulting x and y
-                ix = std::min(std::max(ratio, 0.0f), 1.0f);
-            }
-            else if (fTm == GShader::TileMode::kMirror)
-            {
-                // get into 0,1 space
-                ix = ratio;
-                ix *= 0.5;
-
-                ix = ix - floor(ix);
-               
-                ix > 0.5 ? ix = 1 - ix : ix = ix;
-                ix *= 2;
-            }
-            else if (fTm == GShader::TileMode::kRepeat)
-            { // get into 0,1 coordinates
-                ix = ratio;
-                ix = ix - GFloorToInt(ix);
-            }
-
-
-            // fx is finding the corresponding colpr
-            // and then putting it in idx
-            fx = ix * (fCount - 1);
-            int idx = GFloorToInt(fx);
-
-            // then, find the colors that correspond
-            GColor c0 = fColors[idx];
-            GColor c1 = fColors[idx + 1];
-
-            // compute the ratio'd location in (0, 1) space
-            float w = fx - idx;
+            return false;
+        }
 
-            GColor mC;
-            // finally, make color and store
-            mC = {
-                c0.r + (w * (c1.r - c0.r)),
-                c0.g + (w * (c1.g - c0.g)),
-                c0.b + (w * (c1.b - c0.b)),
-                c0.a + (w * (c1.a - c0.a))};
+        // size the color table from the radius on the device (along its longest axis)
+        float rx = std::hypot(ctm[GMatrix::SX], ctm[GMatrix::KY]) * fRadius;
+        float ry = std::hypot(ctm[GMatrix::KX], ctm[GMatrix::SY]) * fRadius;
+        int size = GradientLUT::SizeFor(std::max(rx, ry));
+        if (!fLUT || fLUT->size() != size)
+        {
+            fLUT = GradientLUT::Get(fColors.data(), fCount, size);
+        }
+        return true;
+    }
 
-            row[i] = ctoP(mC);
-            
-            // only incrementing x by a
-            mX = fInv[0] + mX;
-            xdiff--;
+    // the float version of shadeRow: lerp the stops themselves instead of reading the table
+    bool appendStages(RasterPipeline *p) override
+    {
+        fStops.fColors = fColors.data();
+        fStops.fCount = fCount;
+        p->append(stage_matrix, &fInv);
+        p->append(stage_xy_to_radius);
+        p->append(unit_tile_stage(fTm));
+        p->append(stage_evenly_spaced_stops, &fStops);
+        p->append(stage_premul);
+        return true;
     }
+
+    // the color table is shared and never changes, so a plain copy will do
+    std::unique_ptr<GShader> clone() const override
+    {
+        return std::unique_ptr<GShader>(new RadialGrad(*this));
     }
 
-    GPixel ctoP(GColor color)
+    // for a given row, find the color on the gradient at that pixel
+    void shadeRow(int x, int y, int count, GPixel row[]) override
     {
-        float a = color.a * 255;
-        float r = color.r * color.a * 255;
-        float g = color.g * color.a * 255;
-        float b = color.b * color.a * 255;
-        return GPixel_PackARGB(a, r, g, b);
+        switch (fTm)
+        {
+        case GShader::kClamp:
+            this->shade<GShader::kClamp>(x, y, count, row);
+            break;
+        case GShader::kRepeat:
+            this->shade<GShader::kRepeat>(x, y, count, row);
+            break;
+        case GShader::kMirror:
+            this->shade<GShader::kMirror>(x, y, count, row);
+            break;
+        }
     }
 
 private:
@@ -135,10 +108,86 @@ private:
     GPoint fCenter;
     float fRadius;
     int fCount;
+    bool fOpaque;
     GShader::TileMode fTm;
+    std::shared_ptr<const GradientLUT> fLUT;
+    GradientStopsCtx fStops;
+
+    /**
+     *  In unit space, pixel i of the row is at p + i * dp, so its squared distance from the
+     *  center is a quadratic in i:
+     *
+     *      d2(i) = |p|^2 + i * 2 (p . dp) + i^2 |dp|^2
+     *
+     *  which forward differences with two adds per pixel. The row goes in chunks: fill in the
+     *  squared distances, take their square roots 4 at a time, then look the colors up.
+     */
+    // dist[i] = sqrt(dist[i]), for dist[i] >= 0. std::sqrt may have to set errno, which keeps
+    // the compiler from vectorizing it, so the SSE2 square root is spelled out
+    static void sqrt_span(float dist[], int n)
+    {
+        int i = 0;
+#ifdef RADIAL_GRAD_SSE2
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm_storeu_ps(dist + i, _mm_sqrt_ps(_mm_loadu_ps(dist + i)));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            dist[i] = std::sqrt(dist[i]);
+        }
+    }
+
+    template <GShader::TileMode TM>
+    void shade(int x, int y, int count, GPixel row[])
+    {
+        const GPixel *lut = fLUT->pixels();
+        const int size = fLUT->size();
+
+        GPoint p = {x + 0.5f, y + 0.5f};
+        fInv.mapPoints(&p, &p, 1);
+        const float dx = fInv[GMatrix::SX];
+        const float dy = fInv[GMatrix::KY];
+        const float dd = dx * dx + dy * dy;
+
+        enum
+        {
+            kChunk = 64
+        };
+        float dist[kChunk];
+        for (int start = 0; start < count; start += kChunk)
+        {
+            const int n = std::min(count - start, (int)kChunk);
+
+            // restart the differences from the exact value every chunk, so they can't drift far
+            float d2 = p.fX * p.fX + p.fY * p.fY;
+            float d1 = 2 * (p.fX * dx + p.fY * dy) + dd;
+            for (int i = 0; i < n; i++)
+            {
+                dist[i] = std::max(d2, 0.0f);
+                d2 += d1;
+                d1 += 2 * dd;
+            }
+            sqrt_span(dist, n);
+            for (int i = 0; i < n; i++)
+            {
+                // pinned so the fixed point t can't overflow
+                float t = std::min(dist[i], (float)(1 << 30));
+                row[start + i] = lut[gradient_index(tile_gradient<TM>((int64_t)(t * kGradientOne)), size)];
+            }
+            p.fX += dx * n;
+            p.fY += dy * n;
+        }
+    }
 };
 
-std::unique_ptr<GShader> GCreateLinearGradient(GPoint center, GColor colors[], int count, float radius, GShader::TileMode mode)
+std::unique_ptr<GShader> GCreateRadialGradient(GPoint center, float radius, const GColor colors[], int count,
+                                               GShader::TileMode mode)
 {
+    if (count < 1 || !(radius > 0))
+    {
+        return nullptr;
+    }
     return std::unique_ptr<GShader>(new RadialGrad(center, colors, count, radius, mode));
-}
\ No newline at end of file
+}
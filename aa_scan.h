@@ -0,0 +1,157 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef aa_scan_DEFINED
+#define aa_scan_DEFINED
+
+#include "GMath.h"
+#include <algorithm>
+#include "scratch_arena.h"
+
+// needs AAEdge from claire_utilz.h, so include it after that
+
+/**
+ *  Anti-aliased scan conversion with exact area coverage.
+ *
+ *  Every edge deposits signed area "deltas" into sparse cells (one cell per pixel the edge
+ *  touches on a row). Summing the deltas along a row, left to right, gives each pixel's
+ *  signed coverage, so the only per-row storage is one row of 8-bit coverage.
+ *  Non-zero winding: coverage = min(1, |sum|).
+ */
+struct CoverageCell
+{
+    int fY;
+    int fX;
+    float fDelta;
+};
+
+static bool cell_order(const CoverageCell &a, const CoverageCell &b)
+{
+    return a.fY != b.fY ? a.fY < b.fY : a.fX < b.fX;
+}
+
+static inline void add_cell(ScratchArray<CoverageCell> &cells, int y, int x, float delta, int w)
+{
+    // deltas only flow to the right, so anything past the last column can't be seen.
+    // anything left of column 0 (float slop from clipping) still flows into column 0
+    if (x < w)
+    {
+        cells.push_back({y, std::max(x, 0), delta});
+    }
+}
+
+/**
+ *  Deposit one (already clipped) edge's coverage deltas. For each row it crosses, the
+ *  piece of the edge inside that row splits its signed height between the pixels it
+ *  passes through, weighted by how much of each pixel lies to its right.
+ */
+static void accumulate_edge(const AAEdge &e, ScratchArray<CoverageCell> &cells, int w)
+{
+    float dir = (float)e.fWind;
+    float dxdy = (e.fX1 - e.fX0) / (e.fY1 - e.fY0);
+    float x = e.fX0;
+    int top = GFloorToInt(e.fY0);
+    int bottom = GCeilToInt(e.fY1);
+
+    for (int y = top; y < bottom; y++)
+    {
+        float dy = std::min((float)(y + 1), e.fY1) - std::max((float)y, e.fY0);
+        float xnext = x + dxdy * dy;
+        float d = dy * dir;
+
+        float x0 = std::min(x, xnext);
+        float x1 = std::max(x, xnext);
+        float x0floor = floorf(x0);
+        float x1ceil = ceilf(x1);
+        int x0i = (int)x0floor;
+        int x1i = (int)x1ceil;
+
+        if (x1i <= x0i + 1)
+        {
+            // stays inside one pixel: split by where its midpoint sits
+            float xmf = 0.5f * (x + xnext) - x0floor;
+            add_cell(cells, y, x0i, d - d * xmf, w);
+            add_cell(cells, y, x0i + 1, d * xmf, w);
+        }
+        else
+        {
+            // crosses several pixels: triangle at each end, equal slices in between
+            float s = 1.0f / (x1 - x0);
+            float x0f = x0 - x0floor;
+            float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+            float x1f = x1 - x1ceil + 1.0f;
+            float am = 0.5f * s * x1f * x1f;
+
+            add_cell(cells, y, x0i, d * a0, w);
+            if (x1i == x0i + 2)
+            {
+                add_cell(cells, y, x0i + 1, d * (1.0f - a0 - am), w);
+            }
+            else
+            {
+                float a1 = s * (1.5f - x0f);
+                add_cell(cells, y, x0i + 1, d * (a1 - a0), w);
+                for (int xi = x0i + 2; xi < x1i - 1 && xi < w; xi++)
+                {
+                    add_cell(cells, y, xi, d * s, w);
+                }
+                float a2 = a1 + (x1i - x0i - 3) * s;
+                add_cell(cells, y, x1i - 1, d * (1.0f - a2 - am), w);
+            }
+            add_cell(cells, y, x1i, d * am, w);
+        }
+        x = xnext;
+    }
+}
+
+static inline uint8_t coverage_to_alpha(float acc)
+{
+    return (uint8_t)std::min(255, (int)(fabsf(acc) * 255 + 0.5f));
+}
+
+/**
+ *  Walks the cells (sorted with cell_order) one row at a time, filling coverage[left...right)
+ *  and calling proc(y, left, right, coverage) for each row that has any. coverage must hold
+ *  w entries; it is indexed by device x.
+ */
+template <typename RowProc>
+void sweep_cells(const ScratchArray<CoverageCell> &cells, int w, uint8_t coverage[], RowProc proc)
+{
+    size_t i = 0;
+    while (i < cells.size())
+    {
+        int y = cells[i].fY;
+        int left = cells[i].fX;
+        int x = left;
+        float acc = 0;
+        while (i < cells.size() && cells[i].fY == y)
+        {
+            int cx = cells[i].fX;
+            // no deltas between cells, so those pixels keep the running coverage
+            uint8_t a = coverage_to_alpha(acc);
+            for (; x < cx; x++)
+            {
+                coverage[x] = a;
+            }
+            for (; i < cells.size() && cells[i].fY == y && cells[i].fX == cx; i++)
+            {
+                acc += cells[i].fDelta;
+            }
+            coverage[cx] = coverage_to_alpha(acc);
+            x = cx + 1;
+        }
+        // still inside the shape: it was clipped on the right, so run to the device edge
+        uint8_t a = coverage_to_alpha(acc);
+        if (a != 0)
+        {
+            for (; x < w; x++)
+            {
+                coverage[x] = a;
+            }
+        }
+        proc(y, left, x, coverage);
+    }
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef active_edges_DEFINED
+#define active_edges_DEFINED
+
+#include "scratch_arena.h"
+#include <cassert>
+#include <cstdint>
+
+// needs Edge from claire_utilz.h, so include it after that
+
+/**
+ *  The scan converter's active edge list, stored as structure-of-arrays: the x's, the
+ *  steps, the last rows and the windings each get their own array. Stepping every edge to
+ *  the next row is then one pass of integer adds over two arrays (which vectorizes), and
+ *  sorting compares plain ints.
+ *
+ *  The arrays come from a ScratchArena, sized once for the most edges that can be active.
+ */
+class ActiveEdgeList
+{
+public:
+    ActiveEdgeList(ScratchArena *arena, int capacity)
+        : fX(arena->make<Fixed16>(capacity)), fDX(arena->make<Fixed16>(capacity)),
+          fLastY(arena->make<int>(capacity)), fWind(arena->make<int>(capacity)), fCapacity(capacity)
+    {
+    }
+
+    int count() const { return fCount; }
+    bool empty() const { return fCount == 0; }
+
+    Fixed16 x(int i) const { return fX[i]; }
+    int wind(int i) const { return fWind[i]; }
+
+    // joins at the tail
+    void add(const Edge &e)
+    {
+        assert(fCount < fCapacity);
+        fX[fCount] = e.fX;
+        fDX[fCount] = e.fDX;
+        fLastY[fCount] = e.fLastY;
+        fWind[fCount] = e.fWind;
+        fCount++;
+    }
+
+    // after row y: drops the edges that ended before it (swap-remove), and steps the rest
+    void retireAndStep(int y)
+    {
+        for (int i = 0; i < fCount;)
+        {
+            if (y > fLastY[i])
+            {
+                fCount--;
+                this->move(fCount, i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+        for (int i = 0; i < fCount; i++)
+        {
+            fX[i] += fDX[i];
+        }
+    }
+
+    // back in (x, dx) order. the list is nearly sorted from one row to the next, so an
+    // insertion sort is close to linear
+    void sortByX()
+    {
+        for (int i = 1; i < fCount; i++)
+        {
+            if (!this->less(fX[i], fDX[i], i - 1))
+            {
+                continue;
+            }
+            Fixed16 x = fX[i], dx = fDX[i];
+            int lastY = fLastY[i], wind = fWind[i];
+            int j = i;
+            for (; j > 0 && this->less(x, dx, j - 1); j--)
+            {
+                this->move(j - 1, j);
+            }
+            fX[j] = x;
+            fDX[j] = dx;
+            fLastY[j] = lastY;
+            fWind[j] = wind;
+        }
+    }
+
+private:
+    bool less(Fixed16 x, Fixed16 dx, int i) const
+    {
+        return x != fX[i] ? x < fX[i] : dx < fDX[i];
+    }
+
+    void move(int from, int to)
+    {
+        fX[to] = fX[from];
+        fDX[to] = fDX[from];
+        fLastY[to] = fLastY[from];
+        fWind[to] = fWind[from];
+    }
+
+    Fixed16 *fX;
+    Fixed16 *fDX;
+    int *fLastY;
+    int *fWind;
+    int fCapacity;
+    int fCount = 0;
+};
+
+#endif
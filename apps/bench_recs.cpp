@@ -72,6 +72,7 @@ public:
 #include "bench_pa3.inc"
 #include "bench_pa4.inc"
 #include "bench_pa5.inc"
+#include "bench_canvas.inc"
 
 const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* { return new RectsBench(false); },
@@ -129,5 +130,38 @@ const GBenchmark::Factory gBenchFactories[] {
         return new GradientBench(colors, 2, "gradient_2_mirror", GShader::kMirror);
     },
 
+    // radial gradients
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }};
+        return new RadialGradientBench(colors, 2, "radial_2");
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
+        return new RadialGradientBench(colors, 3, "radial_3_repeat", GShader::kRepeat);
+    },
+
+    // bitmap thumbnails
+    []() -> GBenchmark* { return new ThumbnailBench(GShader::kNearest,  "thumb_nearest");  },
+    []() -> GBenchmark* { return new ThumbnailBench(GShader::kBilinear, "thumb_bilinear"); },
+    []() -> GBenchmark* { return new ThumbnailBench(GShader::kMipmap,   "thumb_mipmap");   },
+
+    // tiled canvas, 1 to N threads
+    []() -> GBenchmark* { return new TiledBench(0,  "tiled_serial"); },
+    []() -> GBenchmark* { return new TiledBench(1,  "tiled_1");  },
+    []() -> GBenchmark* { return new TiledBench(2,  "tiled_2");  },
+    []() -> GBenchmark* { return new TiledBench(4,  "tiled_4");  },
+    []() -> GBenchmark* { return new TiledBench(8,  "tiled_8");  },
+    []() -> GBenchmark* { return new TiledBench(16, "tiled_16"); },
+    []() -> GBenchmark* { return new TiledBench(32, "tiled_32"); },
+
+    // 100k draws, one call each vs one batch
+    []() -> GBenchmark* { return new BatchBench(false, false, "rects_100k");       },
+    []() -> GBenchmark* { return new BatchBench(true,  false, "rects_100k_batch"); },
+    []() -> GBenchmark* { return new BatchBench(false, true,  "polys_100k");       },
+    []() -> GBenchmark* { return new BatchBench(true,  true,  "polys_100k_batch"); },
+
+    // mostly off-screen draws
+    []() -> GBenchmark* { return new ScrollListBench(); },
+
     nullptr,
 };
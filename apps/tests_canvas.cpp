@@ -0,0 +1,1092 @@
+/**
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#include "GCanvas.h"
+#include "GBitmap.h"
+#include "GPaint.h"
+#include "GPath.h"
+#include "GPicture.h"
+#include "GRandom.h"
+#include "GShader.h"
+#include "tests.h"
+
+static int alpha_at(const GBitmap& bm, int x, int y) {
+    return GPixel_GetA(*bm.getAddr(x, y));
+}
+
+static int count_diffs(const GBitmap& a, const GBitmap& b) {
+    int diffs = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        for (int x = 0; x < a.width(); ++x) {
+            diffs += *a.getAddr(x, y) != *b.getAddr(x, y);
+        }
+    }
+    return diffs;
+}
+
+static void test_aa_coverage(GTestStats* stats) {
+    GSurface surface(32, 32);
+    GCanvas* canvas = surface.canvas();
+    canvas->clear({0, 0, 0, 0});
+
+    GPaint paint({0, 0, 0, 1});
+    paint.setAntiAlias(true);
+    const GPoint quad[] = { {4.5f, 4.25f}, {10.25f, 4.25f}, {10.25f, 10.75f}, {4.5f, 10.75f} };
+    canvas->drawConvexPolygon(quad, 4, paint);
+
+    const GBitmap& bm = surface.bitmap();
+    EXPECT_EQ(stats, alpha_at(bm, 6, 6), 255);      // inside
+    EXPECT_EQ(stats, alpha_at(bm, 4, 6), 128);      // left column is half covered
+    EXPECT_EQ(stats, alpha_at(bm, 10, 6), 64);      // right column is a quarter covered
+    EXPECT_EQ(stats, alpha_at(bm, 6, 4), 191);      // top row is 3/4 covered
+    EXPECT_EQ(stats, alpha_at(bm, 4, 4), 96);       // corner: 1/2 * 3/4
+    EXPECT_EQ(stats, alpha_at(bm, 3, 6), 0);        // outside
+    EXPECT_EQ(stats, alpha_at(bm, 11, 6), 0);
+
+    // a path that covers the whole device must leave no gaps at the clipped edges
+    canvas->clear({0, 0, 0, 0});
+    GPath path;
+    path.addRect(GRect::LTRB(-10, -10, 50, 50));
+    canvas->drawPath(path, paint);
+    int uncovered = 0;
+    for (int y = 0; y < bm.height(); ++y) {
+        for (int x = 0; x < bm.width(); ++x) {
+            uncovered += alpha_at(bm, x, y) != 255;
+        }
+    }
+    EXPECT_EQ(stats, uncovered, 0);
+}
+
+// stripes in device space, and no clone(): the tiled canvas has to share it between threads
+class StripeShader : public GShader {
+public:
+    bool isOpaque() override { return false; }
+    bool setContext(const GMatrix&) override { return true; }
+    void shadeRow(int x, int y, int count, GPixel row[]) override {
+        for (int i = 0; i < count; ++i) {
+            row[i] = ((x + i + y) & 4) ? GPixel_PackARGB(128, 0, 64, 0) : GPixel_PackARGB(0, 0, 0, 0);
+        }
+    }
+};
+
+// a bit of everything: solid and shaded, aliased and AA, under a few CTMs
+static void draw_tiled_scene(GCanvas* canvas) {
+    canvas->clear({1, 1, 1, 1});
+    canvas->fillRect(GRect::LTRB(-5, 10, 70, 90), {1, 0, 0, 0.5f});
+
+    const GColor colors[] = {{0, 0, 1, 1}, {0, 1, 0, 0.5f}, {1, 0, 0, 1}};
+    auto shader = GCreateLinearGradient({0, 0}, {100, 150}, colors, 3, GShader::kMirror);
+    GPaint shaded(shader.get());
+    canvas->drawRect(GRect::LTRB(20, 30, 120, 140), shaded);
+
+    // empty if it were rounded before being mapped, but it fills row 64 (a band's first row)
+    canvas->save();
+    canvas->scale(1, 10);
+    canvas->fillRect(GRect::LTRB(10, 6.35f, 60, 6.45f), {0, 0, 1, 1});
+    canvas->restore();
+
+    canvas->save();
+    canvas->translate(60, 75);
+    canvas->rotate(0.3f);
+    GPath path;
+    path.addCircle({0, 0}, 50);
+    path.addRect(GRect::LTRB(-30, -70, 30, 70), GPath::kCCW_Direction);
+    canvas->drawPath(path, GPaint({0, 0.5f, 0, 0.75f}));
+
+    GPaint aa({0.2f, 0.2f, 0.8f, 0.6f});
+    aa.setAntiAlias(true);
+    aa.setBlendMode(GBlendMode::kXor);
+    const GPoint tri[] = {{-40, 60}, {45, -20}, {50, 90}};
+    canvas->drawConvexPolygon(tri, 3, aa);
+    canvas->drawPath(path, shaded.setAntiAlias(true));
+    canvas->restore();
+
+    // minified, so every band reads the same mip pyramid
+    GPixel checker[64 * 64];
+    for (int i = 0; i < 64 * 64; ++i) {
+        checker[i] = ((i ^ (i >> 6)) & 1) ? GPixel_PackARGB(255, 255, 0, 0) : GPixel_PackARGB(255, 0, 0, 255);
+    }
+    GBitmap src(64, 64, 64 * sizeof(GPixel), checker, true);
+    auto bitmap = GCreateBitmapShader(src, GMatrix::Scale(0.3f, 0.3f), GShader::kRepeat,
+                                      GShader::kMipmap);
+    canvas->drawRect(GRect::LTRB(100, 5, 145, 165), GPaint(bitmap.get()));
+
+    StripeShader stripes;
+    GPaint striped(&stripes);
+    striped.setAntiAlias(true);
+    const GPoint quad[] = {{80, 2}, {140, 60}, {120, 168}, {70, 120}};
+    canvas->drawConvexPolygon(quad, 4, striped);
+
+    GPaint paint({0, 0, 0, 0.25f});
+    paint.setBlendMode(GBlendMode::kDstATop);
+    canvas->drawPaint(paint);
+
+    // the shaders (and the bitmap's pixels) have to outlive any deferred drawing
+    canvas->flush();
+}
+
+static void test_tiled_canvas(GTestStats* stats) {
+    const int W = 150, H = 170;
+    GSurface serial(W, H);
+    draw_tiled_scene(serial.canvas());
+    serial.canvas()->fillRect(GRect::LTRB(10, 100, 140, 110), {0, 0, 0, 0.5f});
+
+    for (int threads : {1, 2, 5}) {
+        GBitmap bm;
+        bm.alloc(W, H);
+        {
+            auto canvas = GCreateTiledCanvas(bm, threads);
+            draw_tiled_scene(canvas.get());
+            // recorded after the last flush, drawn when the canvas goes away
+            canvas->fillRect(GRect::LTRB(10, 100, 140, 110), {0, 0, 0, 0.5f});
+        }
+        EXPECT_EQ(stats, count_diffs(bm, serial.bitmap()), 0);
+        free(bm.pixels());
+    }
+
+    // the built in shaders can all be cloned, so bands never wait on each other for them
+    const GColor colors[] = {{0, 0, 1, 1}, {1, 0, 0, 1}};
+    GPixel pixel = GPixel_PackARGB(255, 0, 0, 0);
+    EXPECT_TRUE(stats, GCreateLinearGradient({0, 0}, {1, 1}, colors, 2)->clone() != nullptr);
+    EXPECT_TRUE(stats, GCreateRadialGradient({0, 0}, 1, colors, 2)->clone() != nullptr);
+    EXPECT_TRUE(stats, GCreateBitmapShader(GBitmap(1, 1, sizeof(GPixel), &pixel, true),
+                                           GMatrix())->clone() != nullptr);
+}
+
+static void draw_picture_scene(GCanvas* canvas, GShader* shader) {
+    canvas->clear({0, 0, 0, 0});
+    canvas->fillRect(GRect::LTRB(5, 5, 60, 40), {1, 0, 0, 0.75f});
+    canvas->save();
+    canvas->translate(50, 50);
+    canvas->rotate(0.5f);
+    GPath path;
+    path.addCircle({0, 0}, 30);
+    path.moveTo(-40, -40).quadTo({0, -80}, {40, -40}).cubicTo({60, 0}, {0, 60}, {-40, 40});
+    canvas->drawPath(path, GPaint(shader));
+    GPaint aa({0, 0, 1, 0.5f});
+    aa.setAntiAlias(true);
+    const GPoint tri[] = {{-30, 10}, {30, -5}, {10, 35}};
+    canvas->drawConvexPolygon(tri, 3, aa);
+    canvas->fillRect(GRect::LTRB(-10, -10, 10, 10), {0, 1, 0, 1});
+    canvas->restore();
+    // far off the device: only costs anything if it isn't culled
+    canvas->fillRect(GRect::LTRB(1000, 1000, 2000, 2000), {0, 0, 0, 1});
+    canvas->drawPaint(GPaint({1, 1, 1, 0.25f}));
+}
+
+// counts the draws that get through its quickReject (anything left of x = 100)
+class CountingCanvas : public GCanvas {
+public:
+    int fDraws = 0;
+
+    void save() override {}
+    void restore() override {}
+    void concat(const GMatrix&) override {}
+    void drawPaint(const GPaint&) override { fDraws++; }
+    void drawRect(const GRect&, const GPaint&) override { fDraws++; }
+    void drawConvexPolygon(const GPoint[], int, const GPaint&) override { fDraws++; }
+    void drawPath(const GPath&, const GPaint&) override { fDraws++; }
+    bool quickReject(const GRect& bounds) const override { return bounds.fLeft >= 100; }
+};
+
+static void test_picture(GTestStats* stats) {
+    const GColor colors[] = {{1, 0, 0, 1}, {0, 0, 1, 0.5f}};
+    auto shader = GCreateLinearGradient({0, 0}, {40, 40}, colors, 2, GShader::kRepeat);
+
+    GPictureRecorder recorder;
+    draw_picture_scene(recorder.beginRecording(), shader.get());
+    std::unique_ptr<GPicture> picture = recorder.finishRecording();
+    EXPECT_TRUE(stats, picture != nullptr);
+    EXPECT_EQ(stats, picture->countOps(), 11);
+
+    GSurface direct(100, 100), played(100, 100);
+    draw_picture_scene(direct.canvas(), shader.get());
+    picture->playback(played.canvas());
+    EXPECT_EQ(stats, count_diffs(direct.bitmap(), played.bitmap()), 0);
+
+    // again, under a CTM, and the canvas's CTM is left alone
+    played.canvas()->translate(20, -10);
+    picture->playback(played.canvas());
+    direct.canvas()->translate(20, -10);
+    draw_picture_scene(direct.canvas(), shader.get());
+    played.canvas()->fillRect(GRect::LTRB(0, 0, 10, 10), {0, 0, 0, 1});
+    direct.canvas()->fillRect(GRect::LTRB(0, 0, 10, 10), {0, 0, 0, 1});
+    EXPECT_EQ(stats, count_diffs(direct.bitmap(), played.bitmap()), 0);
+
+    // the rect at 1000 is culled; the rest (and drawPaint, which has no bounds) are drawn
+    CountingCanvas counter;
+    picture->playback(&counter);
+    EXPECT_EQ(stats, counter.fDraws, 6);
+
+    // a concat outside any save doesn't leak into the canvas either
+    GCanvas* recording = recorder.beginRecording();
+    recording->translate(30, 30);
+    recording->scale(2, 2);
+    GPath path;
+    path.addCircle({5, 5}, 5);
+    recording->drawPath(path, GPaint({0, 1, 0, 1}));
+    recording->drawPath(path.addRect(GRect::LTRB(0, 0, 4, 4)), GPaint({0, 0, 1, 0.5f}));
+    picture = recorder.finishRecording();
+    GSurface expected(100, 100), replayed(100, 100);
+    GCanvas* canvas = expected.canvas();
+    canvas->save();
+    canvas->translate(30, 30);
+    canvas->scale(2, 2);
+    GPath circle;
+    circle.addCircle({5, 5}, 5);
+    canvas->drawPath(circle, GPaint({0, 1, 0, 1}));
+    canvas->drawPath(path, GPaint({0, 0, 1, 0.5f}));
+    canvas->restore();
+    canvas->fillRect(GRect::LTRB(0, 0, 10, 10), {0, 0, 0, 1});
+    picture->playback(replayed.canvas());
+    replayed.canvas()->fillRect(GRect::LTRB(0, 0, 10, 10), {0, 0, 0, 1});
+    EXPECT_EQ(stats, count_diffs(expected.bitmap(), replayed.bitmap()), 0);
+}
+
+static bool same_path(const GPath& a, const GPath& b) {
+    GPath::Iter ia(a), ib(b);
+    GPoint pa[GPath::kMaxNextPoints], pb[GPath::kMaxNextPoints];
+    for (;;) {
+        GPath::Verb va = ia.next(pa);
+        if (va != ib.next(pb)) {
+            return false;
+        }
+        if (va == GPath::kDone) {
+            return true;
+        }
+        int n = va == GPath::kMove ? 1 : (va == GPath::kLine ? 2 : (va == GPath::kQuad ? 3 : 4));
+        for (int i = 0; i < n; ++i) {
+            if (pa[i] != pb[i]) {
+                return false;
+            }
+        }
+    }
+}
+
+static void test_path_sharing(GTestStats* stats) {
+    GPath path;
+    path.reserve(20, 10);
+    EXPECT_EQ(stats, path.countPoints(), 0);
+    path.addCircle({10, 10}, 5);
+    const int n = path.countPoints();
+
+    // editing a copy leaves the original alone (and vice versa)
+    GPath copy = path;
+    copy.lineTo(0, 0);
+    EXPECT_EQ(stats, path.countPoints(), n);
+    EXPECT_EQ(stats, copy.countPoints(), n + 1);
+    GPath copy2(path);
+    path.offset(5, 0);
+    EXPECT_FALSE(stats, same_path(path, copy2));
+    copy2.offset(5, 0);
+    EXPECT_TRUE(stats, same_path(path, copy2));
+
+    // moving empties the source, which is still usable
+    GPath moved(std::move(copy));
+    EXPECT_EQ(stats, moved.countPoints(), n + 1);
+    EXPECT_EQ(stats, copy.countPoints(), 0);
+    copy.moveTo(1, 1).lineTo(2, 2);
+    EXPECT_EQ(stats, copy.countPoints(), 2);
+    copy = std::move(moved);
+    EXPECT_EQ(stats, copy.countPoints(), n + 1);
+
+    // transforming into another path matches transforming in place
+    const GMatrix m = GMatrix::Translate(3, 4) * GMatrix::Rotate(0.7f) * GMatrix::Scale(2, 3);
+    GPath dst = copy2;  // sharing storage with copy2 until it is overwritten
+    path.transform(m, &dst);
+    GPath inplace = path;
+    inplace.transform(m);
+    EXPECT_TRUE(stats, same_path(dst, inplace));
+    EXPECT_FALSE(stats, same_path(dst, copy2));
+    EXPECT_TRUE(stats, same_path(path, copy2));
+}
+
+// the src pixel a bitmap shader should return for device pixel (x, y): map the pixel center,
+// floor, then tile
+static GPixel expected_sample(const GBitmap& bm, const GMatrix& inv, GShader::TileMode tm,
+                              int x, int y) {
+    GPoint p = {x + 0.5f, y + 0.5f};
+    inv.mapPoints(&p, &p, 1);
+    int coord[] = { GFloorToInt(p.fX), GFloorToInt(p.fY) };
+    const int size[] = { bm.width(), bm.height() };
+    for (int i = 0; i < 2; ++i) {
+        int c = coord[i], n = size[i];
+        if (tm == GShader::kClamp) {
+            c = std::min(std::max(c, 0), n - 1);
+        } else if (tm == GShader::kRepeat) {
+            c = ((c % n) + n) % n;
+        } else {
+            c = ((c % (2 * n)) + 2 * n) % (2 * n);
+            c = c < n ? c : 2 * n - 1 - c;
+        }
+        coord[i] = c;
+    }
+    return *bm.getAddr(coord[0], coord[1]);
+}
+
+static void test_bitmap_shader_tiling(GTestStats* stats) {
+    const GShader::TileMode modes[] = { GShader::kClamp, GShader::kRepeat, GShader::kMirror };
+    // translate, scale + translate and skewed (all exact in float, so the stepping can't drift)
+    const GMatrix matrices[] = {
+        GMatrix::Translate(-3, 5),
+        GMatrix(2, 0, -7, 0, 0.5f, 3),
+        GMatrix(1, 0.5f, 3, 0, 1, -2),
+    };
+    // 4x4 tiles with masks, 3x5 with divides
+    const int sizes[][2] = { {4, 4}, {3, 5} };
+
+    for (auto& size : sizes) {
+        GBitmap bm;
+        bm.alloc(size[0], size[1]);
+        for (int y = 0; y < bm.height(); ++y) {
+            for (int x = 0; x < bm.width(); ++x) {
+                *bm.getAddr(x, y) = GPixel_PackARGB(255, x * 40, y * 40, 7);
+            }
+        }
+        for (auto tm : modes) {
+            for (auto& m : matrices) {
+                auto shader = GCreateBitmapShader(bm, m, tm);
+                EXPECT_TRUE(stats, shader->setContext(GMatrix()));
+                GMatrix inv;
+                m.invert(&inv);
+
+                GPixel row[40];
+                int bad = 0;
+                for (int y = -12; y < 12; ++y) {
+                    shader->shadeRow(-20, y, 40, row);
+                    for (int i = 0; i < 40; ++i) {
+                        bad += row[i] != expected_sample(bm, inv, tm, -20 + i, y);
+                    }
+                }
+                EXPECT_EQ(stats, bad, 0);
+            }
+        }
+        free(bm.pixels());
+    }
+}
+
+static void test_bitmap_shader_sampling(GTestStats* stats) {
+    GPixel row[8];
+
+    // a black and a white pixel, stretched 4x: bilinear ramps between the two centers
+    GBitmap bm;
+    bm.alloc(2, 1);
+    *bm.getAddr(0, 0) = GPixel_PackARGB(255, 0, 0, 0);
+    *bm.getAddr(1, 0) = GPixel_PackARGB(255, 255, 255, 255);
+    auto shader = GCreateBitmapShader(bm, GMatrix::Scale(4, 1), GShader::kClamp, GShader::kBilinear);
+    EXPECT_TRUE(stats, shader->setContext(GMatrix()));
+    shader->shadeRow(0, 0, 8, row);
+    EXPECT_EQ(stats, GPixel_GetR(row[0]), 0);       // clamped to the first pixel
+    EXPECT_EQ(stats, GPixel_GetR(row[3]), 96);      // 3/8 of the way
+    EXPECT_EQ(stats, GPixel_GetR(row[4]), 159);     // 5/8 of the way
+    EXPECT_EQ(stats, GPixel_GetR(row[7]), 255);
+    EXPECT_EQ(stats, GPixel_GetA(row[3]), 255);
+    free(bm.pixels());
+
+    // a 1 pixel checkerboard, shrunk 16x: nearest picks black or white, mipmap the average
+    bm.alloc(64, 64);
+    for (int y = 0; y < 64; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            *bm.getAddr(x, y) = (x + y) & 1 ? GPixel_PackARGB(255, 255, 255, 255)
+                                            : GPixel_PackARGB(255, 0, 0, 0);
+        }
+    }
+    const GMatrix shrink = GMatrix::Scale(1 / 16.0f, 1 / 16.0f);
+    shader = GCreateBitmapShader(bm, shrink, GShader::kClamp, GShader::kNearest);
+    EXPECT_TRUE(stats, shader->setContext(GMatrix()));
+    shader->shadeRow(0, 1, 4, row);
+    int extremes = 0;
+    for (int i = 0; i < 4; ++i) {
+        extremes += GPixel_GetR(row[i]) == 0 || GPixel_GetR(row[i]) == 255;
+    }
+    EXPECT_EQ(stats, extremes, 4);
+
+    shader = GCreateBitmapShader(bm, shrink, GShader::kClamp, GShader::kMipmap);
+    for (int pass = 0; pass < 2; ++pass) {  // the second draw reuses the pyramid
+        EXPECT_TRUE(stats, shader->setContext(GMatrix()));
+        shader->shadeRow(0, 1, 4, row);
+        int gray = 0;
+        for (int i = 0; i < 4; ++i) {
+            gray += row[i] == GPixel_PackARGB(255, 128, 128, 128);
+        }
+        EXPECT_EQ(stats, gray, 4);
+    }
+    // unscaled, it reads the bitmap itself
+    EXPECT_TRUE(stats, shader->setContext(GMatrix::Scale(16, 16)));
+    shader->shadeRow(0, 0, 2, row);
+    EXPECT_EQ(stats, GPixel_GetR(row[0]), 0);
+    EXPECT_EQ(stats, GPixel_GetR(row[1]), 255);
+    free(bm.pixels());
+}
+
+static void test_linear_gradient(GTestStats* stats) {
+    const GColor colors[] = { {1, 0, 0, 1}, {0, 0, 1, 1} };  // opaque red -> opaque blue
+    const GPixel red = GPixel_PackARGB(255, 255, 0, 0);
+    const GPixel blue = GPixel_PackARGB(255, 0, 0, 255);
+    GPixel row[8];
+
+    // colors[0] is at p0, whichever way the gradient points. (translating by half a pixel
+    // puts pixel centers on whole coordinates)
+    const GMatrix centers = GMatrix::Translate(0.5f, 0);
+    auto shader = GCreateLinearGradient({100, 0}, {0, 0}, colors, 2);
+    EXPECT_TRUE(stats, shader->setContext(centers));
+    shader->shadeRow(0, 0, 1, row);
+    shader->shadeRow(100, 0, 1, row + 1);
+    shader->shadeRow(50, 0, 1, row + 2);
+    EXPECT_EQ(stats, row[0], blue);
+    EXPECT_EQ(stats, row[1], red);
+    EXPECT_EQ(stats, GPixel_GetA(row[2]), 255);
+    EXPECT_EQ(stats, GPixel_GetG(row[2]), 0);
+    EXPECT_TRUE(stats, GPixel_GetR(row[2]) > 100 && GPixel_GetB(row[2]) > 100);
+
+    // over 4 pixels: clamp holds the ends, repeat restarts, mirror turns around
+    const struct { GShader::TileMode fMode; GPixel fAt4, fAt6; } cases[] = {
+        { GShader::kClamp,  blue, blue },
+        { GShader::kRepeat, red,  0 },
+        { GShader::kMirror, blue, 0 },
+    };
+    for (auto& c : cases) {
+        shader = GCreateLinearGradient({0, 0}, {4, 0}, colors, 2, c.fMode);
+        EXPECT_TRUE(stats, shader->setContext(centers));
+        shader->shadeRow(0, 0, 8, row);
+        EXPECT_EQ(stats, row[0], red);
+        EXPECT_EQ(stats, row[4], c.fAt4);
+        if (c.fAt6) {
+            EXPECT_EQ(stats, row[6], c.fAt6);
+        }
+    }
+
+    // opaque stops make an opaque shader, and drawing it with kSrcOver just stores its colors
+    // (shader is still the mirror one, and row its shading of the first row). the canvas
+    // lerps the stops in float, so it can be a bit off from shadeRow's table
+    auto near = [](GPixel a, GPixel b) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            if (std::abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF)) > 1) {
+                return false;
+            }
+        }
+        return true;
+    };
+    EXPECT_TRUE(stats, shader->isOpaque());
+    const GColor seeThrough[] = { {1, 0, 0, 1}, {0, 0, 1, 0.5f} };
+    EXPECT_FALSE(stats, GCreateLinearGradient({0, 0}, {4, 0}, seeThrough, 2)->isOpaque());
+    {
+        GSurface surface(8, 2);
+        surface.canvas()->clear({0, 1, 0, 0.5f});
+        GPaint paint(shader.get());
+        surface.canvas()->concat(centers);
+        surface.canvas()->drawPaint(paint);
+        int far = 0;
+        for (int i = 0; i < 8; ++i) {
+            far += !near(*surface.bitmap().getAddr(i, 1), row[i]);
+        }
+        EXPECT_EQ(stats, far, 0);
+    }
+
+    // a single color is just that color, and no colors is no shader
+    shader = GCreateLinearGradient({0, 0}, {4, 0}, colors + 1, 1);
+    EXPECT_TRUE(stats, shader->setContext(GMatrix()));
+    shader->shadeRow(-10, 3, 8, row);
+    EXPECT_EQ(stats, row[0], blue);
+    EXPECT_EQ(stats, row[7], blue);
+    EXPECT_NULL(stats, GCreateLinearGradient({0, 0}, {4, 0}, colors, 0).get());
+}
+
+static void test_radial_gradient(GTestStats* stats) {
+    const GColor colors[] = { {1, 0, 0, 1}, {0, 0, 1, 1} };  // opaque red -> opaque blue
+    const GPixel red = GPixel_PackARGB(255, 255, 0, 0);
+    const GPixel blue = GPixel_PackARGB(255, 0, 0, 255);
+    const GMatrix centers = GMatrix::Translate(0.5f, 0.5f);
+    GPixel row[21];
+
+    // pixel centers on whole coordinates, so row y is the points (-10, y) ... (10, y)
+    auto shade = [&](GShader* shader, int y) { shader->shadeRow(-10, y, 21, row); };
+
+    auto shader = GCreateRadialGradient({0, 0}, 10, colors, 2);
+    EXPECT_TRUE(stats, shader->setContext(centers));
+    shade(shader.get(), 0);
+    EXPECT_EQ(stats, row[10], red);
+    EXPECT_EQ(stats, row[0], blue);
+    EXPECT_EQ(stats, row[20], blue);
+    const GPixel half = row[15];  // 5 from the center
+    EXPECT_EQ(stats, row[5], half);
+    shade(shader.get(), 3);
+    EXPECT_EQ(stats, row[14], half);  // (4, 3)
+    EXPECT_EQ(stats, row[6], half);   // (-4, 3)
+    shade(shader.get(), -5);
+    EXPECT_EQ(stats, row[10], half);  // (0, -5)
+
+    // 15 from the center: repeat and mirror both land halfway
+    for (auto mode : { GShader::kRepeat, GShader::kMirror }) {
+        shader = GCreateRadialGradient({0, 0}, 10, colors, 2, mode);
+        EXPECT_TRUE(stats, shader->setContext(centers));
+        shader->shadeRow(15, 0, 1, row);
+        EXPECT_EQ(stats, row[0], half);
+    }
+
+    EXPECT_TRUE(stats, shader->isOpaque());
+    const GColor seeThrough[] = { {1, 0, 0, 0}, {0, 0, 1, 1} };
+    EXPECT_FALSE(stats, GCreateRadialGradient({0, 0}, 10, seeThrough, 2)->isOpaque());
+
+    EXPECT_NULL(stats, GCreateRadialGradient({0, 0}, 10, colors, 0).get());
+    EXPECT_NULL(stats, GCreateRadialGradient({0, 0}, 0, colors, 2).get());
+}
+
+// every blend mode, through the canvas's shader pipeline, against the formulas in GBlendMode.h
+static void test_shader_blend_modes(GTestStats* stats) {
+    const float S[] = { 0.5f, 0.4f, 0.2f, 0.1f };   // premul a, r, g, b
+    const float D[] = { 0.75f, 0.25f, 0.5f, 0.75f };
+    auto byte = [](float v) { return (int)(v * 255 + 0.5f); };
+
+    GBitmap src;
+    src.alloc(1, 1);
+    *src.getAddr(0, 0) = GPixel_PackARGB(byte(S[0]), byte(S[1]), byte(S[2]), byte(S[3]));
+    auto shader = GCreateBitmapShader(src, GMatrix());
+    const float sa = GPixel_GetA(*src.getAddr(0, 0)) / 255.0f;
+
+    // {Fs, Fd} per mode, with sa and da plugged in below
+    for (int m = 0; m <= (int)GBlendMode::kXor; ++m) {
+        GSurface surface(4, 1);
+        surface.canvas()->clear({D[1] / D[0], D[2] / D[0], D[3] / D[0], D[0]});
+        const GPixel dst = *surface.bitmap().getAddr(0, 0);
+        const float da = GPixel_GetA(dst) / 255.0f;
+        const float factors[][2] = {
+            {0, 0}, {1, 0}, {0, 1}, {1, 1 - sa}, {1 - da, 1}, {da, 0},
+            {0, sa}, {1 - da, 0}, {0, 1 - sa}, {da, 1 - sa}, {1 - da, sa}, {1 - da, 1 - sa},
+        };
+
+        GPaint paint(shader.get());
+        paint.setBlendMode((GBlendMode)m);
+        surface.canvas()->drawPaint(paint);
+
+        const GPixel s = *src.getAddr(0, 0);
+        const GPixel result = *surface.bitmap().getAddr(3, 0);
+        int off = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            float sc = ((s >> shift) & 0xFF) / 255.0f;
+            float dc = ((dst >> shift) & 0xFF) / 255.0f;
+            int expected = byte(sc * factors[m][0] + dc * factors[m][1]);
+            off += std::abs((int)((result >> shift) & 0xFF) - expected) > 1;
+        }
+        EXPECT_EQ(stats, off, 0);
+    }
+
+    // the paint's alpha scales the shader's colors
+    GSurface surface(4, 1);
+    surface.canvas()->clear({0, 0, 0, 0});
+    GPaint paint(shader.get());
+    paint.setAlpha(0.5f);
+    surface.canvas()->drawPaint(paint);
+    EXPECT_TRUE(stats, std::abs(GPixel_GetA(*surface.bitmap().getAddr(0, 0)) - byte(sa * 0.5f)) <= 1);
+    free(src.pixels());
+}
+
+// scratch comes from the canvas's arena, so neither the device width nor the vertex count is
+// limited by the stack (a million points used to be 8MB of stack)
+static void test_scratch_limits(GTestStats* stats) {
+    const int W = 20000, H = 4;
+    const int N = 1 << 20;
+    const int R = W - 1;   // inside the device, so no edge gets clipped
+    std::vector<GPoint> pts;
+    pts.reserve(N + 2);
+    for (int i = 0; i < N; ++i) {
+        pts.push_back({R * (float)i / (N - 1), 0});   // a long run of collinear points along the top
+    }
+    pts.push_back({(float)R, (float)H});
+    pts.push_back({0, (float)H});
+
+    for (bool aa : {false, true}) {
+        GSurface surface(W, H);
+        surface.canvas()->clear({0, 0, 0, 0});
+        GPaint paint({0, 0, 0, 1});
+        paint.setAntiAlias(aa);
+        surface.canvas()->drawConvexPolygon(pts.data(), (int)pts.size(), paint);
+        int opaque = 0;
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; ++x) {
+                opaque += alpha_at(surface.bitmap(), x, y) == 255;
+            }
+        }
+        EXPECT_EQ(stats, opaque, R * H);
+    }
+}
+
+// aliased edges step in 16.16 fixed point: even thousands of rows down, a row's left edge is
+// still exactly where the line is
+static void test_fixed_point_edges(GTestStats* stats) {
+    // far enough right that float steps (with an ulp of ~1/4096 there) drifted off the line
+    const int W = 2700, H = 2000;
+    const float X0 = 2000.1f;
+    const GPoint pts[] = {{X0, 0}, {X0 + H / 3.0f, (float)H}, {(float)W, (float)H}, {(float)W, 0}};
+    GSurface surface(W, H);
+    surface.canvas()->clear({0, 0, 0, 0});
+    surface.canvas()->drawConvexPolygon(pts, 4, GPaint({0, 0, 0, 1}));
+
+    int wrong = 0;
+    for (int y = 1; y < H - 1; ++y) {
+        // x = X0 + y / 3 at the row's center, which is never a tie
+        int expected = (int)std::floor(2000.1 + (y + 0.5) / 3 + 0.5);
+        int left = 0;
+        while (left < W && alpha_at(surface.bitmap(), left, y) == 0) {
+            left++;
+        }
+        wrong += left != expected;
+    }
+    EXPECT_EQ(stats, wrong, 0);
+}
+
+static void test_convex_walk(GTestStats* stats) {
+    // aliased fills cover exactly the pixels whose centers are inside. shapes clipped on
+    // every side, with flat edges and edges shorter than a row (centers within a hair of
+    // an edge are skipped)
+    const GPoint shapes[][6] = {
+        {{-20, 10}, {30, -15}, {70, 4}, {70.5f, 4.4f}, {90, 60}, {10, 120}},
+        {{5.5f, 5.5f}, {50.25f, 5.5f}, {60, 30}, {50.25f, 70.4f}, {5.5f, 70.4f}, {0.3f, 30}},
+        {{40, 2}, {41, 2.3f}, {80, 50}, {79.5f, 50.6f}, {2, 90}, {1, 89.7f}},
+    };
+    const int W = 80, H = 100;
+    int wrong = 0;
+    for (const auto& pts : shapes) {
+        GSurface surface(W, H);
+        surface.canvas()->clear({0, 0, 0, 0});
+        surface.canvas()->drawConvexPolygon(pts, 6, GPaint({0, 0, 0, 1}));
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; ++x) {
+                // distance inside the nearest edge (the shapes all wind clockwise on screen)
+                double inside = 1e9;
+                for (int i = 0; i < 6; ++i) {
+                    GPoint a = pts[i], b = pts[(i + 1) % 6];
+                    double ex = b.fX - a.fX, ey = b.fY - a.fY;
+                    double d = (ex * (y + 0.5 - a.fY) - ey * (x + 0.5 - a.fX)) / std::hypot(ex, ey);
+                    inside = std::min(inside, d);
+                }
+                if (std::abs(inside) > 1e-3) {
+                    wrong += (alpha_at(surface.bitmap(), x, y) != 0) != (inside > 0);
+                }
+            }
+        }
+    }
+    EXPECT_EQ(stats, wrong, 0);
+}
+
+static void test_rect_engine(GTestStats* stats) {
+    // a solid fill big enough to stream, with rows that start off a 16-byte boundary
+    const int W = 1030, H = 520;
+    GSurface big(W, H);
+    big.canvas()->clear({0, 0, 0, 0});
+    big.canvas()->fillRect(GRect::LTRB(0.6f, 1.2f, 1029.4f, 519.6f), {0, 1, 0, 1});
+    int wrong = 0;
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            bool inside = x >= 1 && x < 1029 && y >= 1;
+            wrong += (alpha_at(big.bitmap(), x, y) != 0) != inside;
+        }
+    }
+    EXPECT_EQ(stats, wrong, 0);
+
+    // shaded, under a scale and translate, as a rect, a rect path and a polygon with a 5th
+    // point (so it's walked, not taken for a rect): all the same pixels
+    const GColor colors[] = {{1, 0, 0, 1}, {0, 0, 1, 1}};
+    auto shader = GCreateLinearGradient({0, 0}, {60, 40}, colors, 2, GShader::kMirror);
+    const GRect r = GRect::LTRB(-3.1f, 2.4f, 40.2f, 30.7f);
+    const GPoint pts[] = {{r.fLeft, r.fTop}, {10, r.fTop}, {r.fRight, r.fTop}, {r.fRight, r.fBottom},
+                          {r.fLeft, r.fBottom}};
+    const GPoint corners[] = {pts[0], pts[2], pts[3], pts[4]};
+    GPath path;
+    path.addPolygon(corners, 4);
+    GSurface surfaces[] = {{100, 100}, {100, 100}, {100, 100}};
+    for (int i = 0; i < 3; ++i) {
+        GCanvas* canvas = surfaces[i].canvas();
+        canvas->clear({0, 0, 0, 0});
+        canvas->translate(10.3f, -4.6f);
+        canvas->scale(1.7f, 2.2f);
+        if (i == 0) {
+            canvas->drawRect(r, GPaint(shader.get()));
+        } else if (i == 1) {
+            canvas->drawPath(path, GPaint(shader.get()));
+        } else {
+            canvas->drawConvexPolygon(pts, 5, GPaint(shader.get()));
+        }
+    }
+    int diffs = 0, drawn = 0;
+    for (int y = 0; y < 100; ++y) {
+        for (int x = 0; x < 100; ++x) {
+            GPixel p = *surfaces[0].bitmap().getAddr(x, y);
+            diffs += p != *surfaces[1].bitmap().getAddr(x, y);
+            diffs += p != *surfaces[2].bitmap().getAddr(x, y);
+            drawn += p != 0;
+        }
+    }
+    EXPECT_EQ(stats, diffs, 0);
+    EXPECT_EQ(stats, drawn, 74 * 62);
+}
+
+static void test_batched_draws(GTestStats* stats) {
+    // a batch draws exactly what its items would one call at a time: colors of every alpha
+    // class, a mode with lowp stages, anti-aliased partial pixels, and a rotated CTM (which
+    // batches rects as polygons)
+    GRandom rand;
+    const int N = 60;
+    GRect rects[N];
+    GColor colors[N];
+    GPoint pts[N * 5];
+    int counts[N];
+    int total = 0;
+    for (int i = 0; i < N; ++i) {
+        float x = rand.nextF() * 90, y = rand.nextF() * 90;
+        rects[i] = GRect::XYWH(x, y, 1 + rand.nextF() * 30, 1 + rand.nextF() * 30);
+        float alpha = i % 3 == 0 ? 1 : (i % 3 == 1 ? 0 : rand.nextF());
+        colors[i] = {rand.nextF(), rand.nextF(), rand.nextF(), alpha};
+        counts[i] = i == 7 ? 2 : 3 + i % 3;  // polygon 7 is too short to draw
+        for (int k = 0; k < counts[i]; ++k) {
+            float angle = k * 6.2831853f / counts[i];
+            pts[total++] = {x + 12 * cosf(angle), y + 12 * sinf(angle)};
+        }
+    }
+
+    int diffs = 0;
+    for (int variant = 0; variant < 4; ++variant) {
+        GPaint paint;
+        paint.setBlendMode(variant == 1 ? GBlendMode::kDstOver : GBlendMode::kSrcOver);
+        paint.setAntiAlias(variant == 2);
+        GSurface batched(100, 100), single(100, 100);
+        for (GSurface* s : {&batched, &single}) {
+            GCanvas* canvas = s->canvas();
+            canvas->clear({0.5f, 0.5f, 0.5f, 0.5f});
+            canvas->translate(3.3f, -2.1f);
+            if (variant == 3) {
+                canvas->rotate(0.4f);
+            } else {
+                canvas->scale(1.1f, 0.9f);
+            }
+            if (s == &batched) {
+                canvas->drawRects(rects, colors, N, paint);
+                canvas->drawConvexPolygons(pts, counts, colors, N, paint);
+                continue;
+            }
+            const GPoint* p = pts;
+            for (int i = 0; i < N; ++i) {
+                canvas->drawRect(rects[i], GPaint(paint).setColor(colors[i]));
+            }
+            for (int i = 0; i < N; p += counts[i], ++i) {
+                canvas->drawConvexPolygon(p, counts[i], GPaint(paint).setColor(colors[i]));
+            }
+        }
+        diffs += count_diffs(batched.bitmap(), single.bitmap());
+    }
+    EXPECT_EQ(stats, diffs, 0);
+}
+
+// defined in my_canvas.cpp: the bytes of scratch a canvas from GCreateCanvas keeps
+size_t GCanvasScratchBytes(const GCanvas* canvas);
+
+static void test_batch_scratch(GTestStats* stats) {
+    // an anti-aliased batch's polygons take turns with the same scratch (each needs a full
+    // width coverage row on a wide canvas), so however long the batch is the canvas keeps
+    // about what one of them drawn alone needs, plus the batch's mapped points
+    const int W = 4000, N = 5000;
+    std::vector<GPoint> pts;
+    std::vector<int> counts(N, 3);
+    std::vector<GColor> colors(N, {0, 0, 1, 0.5f});
+    for (int i = 0; i < N; ++i) {
+        float x = (float)(i * 37 % (W - 20)), y = (float)(i * 13 % 40);
+        pts.push_back({x + 0.5f, y + 0.25f});
+        pts.push_back({x + 15.5f, y + 5.75f});
+        pts.push_back({x + 4.25f, y + 19.5f});
+    }
+    GPaint paint;
+    paint.setAntiAlias(true);
+
+    GSurface single(W, 64), batched(W, 64);
+    single.canvas()->drawConvexPolygon(pts.data(), 3, GPaint(paint).setColor(colors[0]));
+    batched.canvas()->drawConvexPolygons(pts.data(), counts.data(), colors.data(), N, paint);
+    const size_t limit = 2 * (GCanvasScratchBytes(single.canvas()) + pts.size() * sizeof(GPoint));
+    EXPECT_TRUE(stats, GCanvasScratchBytes(batched.canvas()) > 0);
+    EXPECT_TRUE(stats, GCanvasScratchBytes(batched.canvas()) <= limit);
+}
+
+static void test_lowp_blend_modes(GTestStats* stats) {
+    // 8-bit premul, as the row procs compute it: S * Fs + D * Fd, where a factor of 1 is
+    // exact and the others are each a rounded product
+    auto div255 = [](int v) { return (v * 65793 + (1 << 23)) >> 24; };
+    const int S[] = { 128, 100, 50, 25 };   // a, r, g, b
+    const int D[] = { 192, 64, 128, 160 };
+    enum { kZero, kOne, kSa, kDa, kISa, kIDa };
+    const int factors[][2] = {
+        {kZero, kZero}, {kOne, kZero}, {kZero, kOne}, {kOne, kISa}, {kIDa, kOne}, {kDa, kZero},
+        {kZero, kSa}, {kIDa, kZero}, {kZero, kISa}, {kDa, kISa}, {kIDa, kSa}, {kIDa, kISa},
+    };
+    auto term = [&](int f, int c) {
+        int k[] = { 0, 255, S[0], D[0], 255 - S[0], 255 - D[0] };
+        return f == kOne ? c : div255(c * k[f]);
+    };
+
+    GBitmap src;
+    src.alloc(1, 1);
+    *src.getAddr(0, 0) = GPixel_PackARGB(S[0], S[1], S[2], S[3]);
+    auto shader = GCreateBitmapShader(src, GMatrix(), GShader::kRepeat);
+
+    // 37 pixels: two full runs of lanes and a short one
+    for (int m = 0; m <= (int)GBlendMode::kXor; ++m) {
+        int expected[4];
+        for (int c = 0; c < 4; ++c) {
+            expected[c] = term(factors[m][0], S[c]) + term(factors[m][1], D[c]);
+        }
+        for (int useShader = 0; useShader <= 1; ++useShader) {
+            GSurface surface(37, 1);
+            for (int x = 0; x < 37; ++x) {
+                *surface.bitmap().getAddr(x, 0) = GPixel_PackARGB(D[0], D[1], D[2], D[3]);
+            }
+            GPaint paint({S[1] / (float)S[0], S[2] / (float)S[0], S[3] / (float)S[0], S[0] / 255.0f});
+            if (useShader) {
+                paint = GPaint(shader.get());
+            }
+            paint.setBlendMode((GBlendMode)m);
+            surface.canvas()->drawPaint(paint);
+
+            // shaded atop and xor go through the float pipeline, which can be off by one
+            const int tolerance = useShader && m >= (int)GBlendMode::kSrcATop ? 1 : 0;
+            int off = 0;
+            for (int x = 0; x < 37; ++x) {
+                GPixel p = *surface.bitmap().getAddr(x, 0);
+                for (int c = 0; c < 4; ++c) {
+                    int actual = (p >> (GPIXEL_SHIFT_A - 8 * c)) & 0xFF;
+                    off += std::abs(actual - expected[c]) > tolerance;
+                }
+            }
+            EXPECT_EQ(stats, off, 0);
+        }
+    }
+    free(src.pixels());
+}
+
+static void test_edge_cache(GTestStats* stats) {
+    GPath path;
+    path.moveTo(10, 5).lineTo(40, 12).quadTo({50, 40}, {20, 45}).cubicTo({5, 40}, {15, 20}, {2, 15});
+
+    // copies share an ID, and editing a path gives it a new one
+    const uint32_t id = path.getGenerationID();
+    EXPECT_NE(stats, id, 0u);
+    EXPECT_EQ(stats, GPath().getGenerationID(), 0u);
+    GPath copy = path;
+    EXPECT_EQ(stats, copy.getGenerationID(), id);
+    copy.lineTo(3, 3);
+    EXPECT_NE(stats, copy.getGenerationID(), id);
+    EXPECT_EQ(stats, path.getGenerationID(), id);
+
+    // each draw's translate, and whether the cache should already have its edges. however
+    // the edges are found, the pixels match a canvas drawing the path for the first time
+    const struct {
+        float fTX, fTY;
+        bool  fHit;
+    } draws[] = {
+        { 0.25f, 0.5f, false },
+        { 0.25f, 0.5f, true  },     // the same CTM
+        { 30.25f, 7.5f, true },     // moved by whole pixels
+        { 30.5f, 7.5f, false },     // ... but not by part of one
+        { 80.5f, 7.5f, false },     // hangs off the right, so clipped
+        { 80.5f, 7.5f, true  },
+        { 81.5f, 7.5f, false },     // clipped edges only fit their own CTM
+    };
+    int diffs = 0;
+    for (int aa = 0; aa <= 1; ++aa) {
+        GPaint paint({0, 0, 0, 1});
+        paint.setAntiAlias(aa);
+        GSurface cached(100, 80);
+        for (const auto& d : draws) {
+            GSurface fresh(100, 80);
+            const GCanvas::CacheStats before = cached.canvas()->edgeCacheStats();
+            for (GCanvas* canvas : {cached.canvas(), fresh.canvas()}) {
+                canvas->clear({0, 0, 0, 0});
+                canvas->save();
+                canvas->translate(d.fTX, d.fTY);
+                canvas->drawPath(path, paint);
+                canvas->restore();
+            }
+            const GCanvas::CacheStats after = cached.canvas()->edgeCacheStats();
+            EXPECT_EQ(stats, after.fHits - before.fHits, (int64_t)d.fHit);
+            EXPECT_EQ(stats, after.fMisses - before.fMisses, (int64_t)!d.fHit);
+            diffs += count_diffs(cached.bitmap(), fresh.bitmap());
+        }
+
+        // an edited path (even one edited back) is a new path
+        GPath edited = path;
+        edited.reset();
+        edited = path;
+        edited.transform(GMatrix());
+        const int64_t misses = cached.canvas()->edgeCacheStats().fMisses;
+        cached.canvas()->drawPath(edited, paint);
+        EXPECT_EQ(stats, cached.canvas()->edgeCacheStats().fMisses, misses + 1);
+    }
+    EXPECT_EQ(stats, diffs, 0);
+
+    // a path drawn under several CTMs in turn keeps an entry for each (movable or clipped), so
+    // after the first round every draw hits
+    {
+        const GMatrix ctms[] = {
+            GMatrix::Translate(10.25f, 5.5f),
+            GMatrix::Concat(GMatrix::Translate(20, 10), GMatrix::Scale(1.5f, 1.25f)),
+            GMatrix::Concat(GMatrix::Translate(50, 10), GMatrix::Rotate(0.5f)),
+            GMatrix::Translate(80.5f, 7.5f),
+        };
+        for (int aa = 0; aa <= 1; ++aa) {
+            GPaint paint({0, 0, 0, 1});
+            paint.setAntiAlias(aa);
+            GSurface surface(100, 80);
+            GCanvas* canvas = surface.canvas();
+            for (int round = 0; round < 3; ++round) {
+                for (const GMatrix& m : ctms) {
+                    const GCanvas::CacheStats before = canvas->edgeCacheStats();
+                    canvas->save();
+                    canvas->concat(m);
+                    canvas->drawPath(path, paint);
+                    canvas->restore();
+                    const GCanvas::CacheStats after = canvas->edgeCacheStats();
+                    EXPECT_EQ(stats, after.fHits - before.fHits, (int64_t)(round > 0));
+                }
+            }
+        }
+    }
+
+    // the cache stays within its budget, evicting the least recently drawn paths. (anti-
+    // aliased edges, as those keep every line, however short)
+    GSurface surface(100, 100);
+    GCanvas* canvas = surface.canvas();
+    GPaint paint;
+    paint.setAntiAlias(true);
+    std::vector<GPath> paths(100);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::vector<GPoint> pts(500);
+        for (size_t k = 0; k < pts.size(); ++k) {
+            float angle = k * 6.2831853f / pts.size();
+            pts[k] = {50 + (10 + i * 0.3f) * cosf(angle), 50 + (10 + i * 0.3f) * sinf(angle)};
+        }
+        paths[i].addPolygon(pts.data(), (int)pts.size());
+        canvas->drawPath(paths[i], paint);
+        EXPECT_TRUE(stats, canvas->edgeCacheStats().fBytes <= canvas->edgeCacheStats().fBudget);
+    }
+    const GCanvas::CacheStats full = canvas->edgeCacheStats();
+    EXPECT_TRUE(stats, full.fBytes > full.fBudget / 4);
+    canvas->drawPath(paths.back(), paint);
+    canvas->drawPath(paths.front(), paint);
+    EXPECT_EQ(stats, canvas->edgeCacheStats().fHits, full.fHits + 1);
+}
+
+static void test_path_bounds(GTestStats* stats) {
+    // nowhere near the old 0...1000 seeds
+    GPath path;
+    path.moveTo(1500, 2000).lineTo(1600, 2500).lineTo(1550, 2100);
+    EXPECT_TRUE(stats, path.bounds() == GRect::LTRB(1500, 2000, 1600, 2500));
+    GPath negative;
+    negative.moveTo(-30, -40).lineTo(-10, -50).lineTo(-20, -5);
+    EXPECT_TRUE(stats, negative.bounds() == GRect::LTRB(-30, -50, -10, -5));
+
+    // kept between calls, but never past an edit (of the path, or of a copy sharing it)
+    GPath copy = path;
+    EXPECT_TRUE(stats, copy.bounds() == path.bounds());
+    copy.lineTo(3000, 0);
+    EXPECT_TRUE(stats, copy.bounds() == GRect::LTRB(1500, 0, 3000, 2500));
+    EXPECT_TRUE(stats, path.bounds() == GRect::LTRB(1500, 2000, 1600, 2500));
+    path.offset(-1500, -2000);
+    EXPECT_TRUE(stats, path.bounds() == GRect::LTRB(0, 0, 100, 500));
+    path.reset();
+    EXPECT_TRUE(stats, path.bounds() == GRect::LTRB(0, 0, 0, 0));
+    path.moveTo(7, 8).lineTo(9, 6);
+    EXPECT_TRUE(stats, path.bounds() == GRect::LTRB(7, 6, 9, 8));
+
+    // tight bounds stop where the curves turn back, short of their control points
+    GPath quad;
+    quad.moveTo(0, 0).quadTo({10, 20}, {20, 0});
+    EXPECT_TRUE(stats, quad.bounds() == GRect::LTRB(0, 0, 20, 20));
+    EXPECT_TRUE(stats, quad.computeTightBounds() == GRect::LTRB(0, 0, 20, 10));
+    GPath cubic;
+    cubic.moveTo(0, 0).cubicTo({-10, 30}, {40, 30}, {30, 0});
+    GRect tight = cubic.computeTightBounds();
+    EXPECT_TRUE(stats, std::abs(tight.fBottom - 22.5f) < 1e-4f);
+    EXPECT_TRUE(stats, tight.fLeft < 0 && tight.fLeft > -10 && tight.fRight > 30 && tight.fRight < 40);
+    EXPECT_TRUE(stats, tight.fTop == 0);
+    GPath circle;
+    circle.addCircle({50, 40}, 10);
+    tight = circle.computeTightBounds();
+    EXPECT_TRUE(stats, std::abs(tight.fLeft - 40) < 1e-3f && std::abs(tight.fTop - 30) < 1e-3f &&
+                       std::abs(tight.fRight - 60) < 1e-3f && std::abs(tight.fBottom - 50) < 1e-3f);
+    EXPECT_TRUE(stats, GPath().computeTightBounds() == GRect::LTRB(0, 0, 0, 0));
+}
+
+// counts the draws that get far enough to set up their shader
+class CountingShader : public GShader {
+public:
+    int fContexts = 0;
+
+    bool isOpaque() override { return true; }
+    bool setContext(const GMatrix&) override { fContexts++; return true; }
+    void shadeRow(int x, int y, int count, GPixel row[]) override {
+        std::fill(row, row + count, GPixel_PackARGB(255, 0, 0, 0));
+    }
+};
+
+static void test_draw_reject(GTestStats* stats) {
+    // draws that land entirely off the canvas (or, for a band, outside its rows) stop before
+    // they set up the shader or build any edges
+    GPath path;
+    path.moveTo(10, 10).quadTo({40, 0}, {30, 30}).lineTo(5, 25);
+    const GPoint tri[] = {{10, 10}, {30, 12}, {15, 30}};
+    const GRect rect = GRect::LTRB(5, 5, 25, 25);
+
+    CountingShader shader;
+    GPaint paint(&shader);
+    const struct {
+        float fTX, fTY, fRadians;
+        bool  fDrawn;
+    } ctms[] = {
+        { 0, 0, 0, true },
+        { -500, 0, 0, false },
+        { 0, 150, 0, false },
+        { 3000, 3000, 0, false },
+        { 160, -40, 0.5f, false },
+        { 60, 60, 0.5f, true },
+    };
+    for (const auto& c : ctms) {
+        GSurface surface(100, 100);
+        GCanvas* canvas = surface.canvas();
+        canvas->translate(c.fTX, c.fTY);
+        canvas->rotate(c.fRadians);
+        shader.fContexts = 0;
+        canvas->drawPath(path, paint);
+        canvas->drawConvexPolygon(tri, 3, paint);
+        canvas->drawRect(rect, paint);
+        EXPECT_EQ(stats, shader.fContexts, c.fDrawn ? 3 : 0);
+        EXPECT_EQ(stats, canvas->edgeCacheStats().fMisses, (int64_t)c.fDrawn);
+    }
+    {
+        // within the pixel of slop past the edge still draws
+        GSurface surface(100, 100);
+        surface.canvas()->translate(-30.5f, 0);
+        shader.fContexts = 0;
+        surface.canvas()->drawConvexPolygon(tri, 3, paint);
+        EXPECT_EQ(stats, shader.fContexts, 1);
+    }
+
+    // the tiled canvas rejects the same draws (its bands reject what misses their rows)
+    GSurface serial(100, 100);
+    GBitmap bm;
+    bm.alloc(100, 100);
+    {
+        auto tiled = GCreateTiledCanvas(bm, 2);
+        for (GCanvas* canvas : {serial.canvas(), tiled.get()}) {
+            canvas->clear({0, 0, 0, 0});
+            for (int i = 0; i < 10; ++i) {
+                canvas->save();
+                canvas->translate(i * 9.5f, i * 40.f - 100);
+                canvas->drawPath(path, GPaint({0, 0, 1, 1}));
+                canvas->restore();
+            }
+        }
+    }
+    // only the middle 4 reach the canvas
+    const GCanvas::CacheStats serialStats = serial.canvas()->edgeCacheStats();
+    EXPECT_EQ(stats, serialStats.fHits + serialStats.fMisses, (int64_t)4);
+    EXPECT_EQ(stats, count_diffs(serial.bitmap(), bm), 0);
+    free(bm.pixels());
+}
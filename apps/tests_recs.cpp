@@ -32,6 +32,7 @@ private:
 #include "tests_pa3.cpp"
 #include "tests_pa4.cpp"
 #include "tests_pa5.cpp"
+#include "tests_canvas.cpp"
 
 const GTestRec gTestRecs[] = {
     { test_matrix,      "matrix_setters"    },
@@ -49,6 +50,26 @@ const GTestRec gTestRecs[] = {
     { test_path_chop_quad,   "path_chop_quad"    },
     { test_path_chop_cubic,   "path_chop_cubic"    },
 
+    { test_aa_coverage, "aa_coverage"       },
+    { test_tiled_canvas, "tiled_canvas"     },
+    { test_picture,     "picture"           },
+    { test_path_sharing, "path_sharing"     },
+    { test_bitmap_shader_tiling, "bitmap_shader_tiling" },
+    { test_bitmap_shader_sampling, "bitmap_shader_sampling" },
+    { test_linear_gradient, "linear_gradient" },
+    { test_radial_gradient, "radial_gradient" },
+    { test_shader_blend_modes, "shader_blend_modes" },
+    { test_lowp_blend_modes, "lowp_blend_modes" },
+    { test_scratch_limits, "scratch_limits" },
+    { test_fixed_point_edges, "fixed_point_edges" },
+    { test_convex_walk, "convex_walk" },
+    { test_rect_engine, "rect_engine" },
+    { test_batched_draws, "batched_draws" },
+    { test_batch_scratch, "batch_scratch" },
+    { test_edge_cache, "edge_cache" },
+    { test_path_bounds, "path_bounds" },
+    { test_draw_reject, "draw_reject" },
+
     { nullptr, nullptr },
 };
 
@@ -0,0 +1,232 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef blend_procs_DEFINED
+#define blend_procs_DEFINED
+
+#include "GBlendMode.h"
+#include "GPixel.h"
+
+// needs srcOver/srcIn/... from claire_utilz.h and srcover_span from span_blit.h,
+// so include it after those two
+
+// blends one constant src into count pixels of dst
+typedef void (*ColorRowProc)(GPixel dst[], GPixel src, int count);
+// blends a row of src pixels (e.g. from a shader) into count pixels of dst
+typedef void (*ShadeRowProc)(GPixel dst[], const GPixel src[], int count);
+// blends a single src pixel into a single dst pixel
+typedef GPixel (*BlendProc)(GPixel src, GPixel dst);
+
+// what we know about the src alpha for a whole draw
+enum class SrcAlpha
+{
+    kTransparent, // every src pixel is 0
+    kOpaque,      // every src pixel has alpha 255
+    kUnknown,
+};
+
+// the blend modes, written as (src, dst) so they can be template args
+static inline GPixel blend_clear(GPixel s, GPixel d) { return 0; }
+static inline GPixel blend_src(GPixel s, GPixel d) { return s; }
+static inline GPixel blend_dst(GPixel s, GPixel d) { return d; }
+static inline GPixel blend_srcover(GPixel s, GPixel d) { return srcOver(s, d); }
+static inline GPixel blend_dstover(GPixel s, GPixel d) { return srcOver(d, s); }
+static inline GPixel blend_srcin(GPixel s, GPixel d) { return srcIn(s, d); }
+static inline GPixel blend_dstin(GPixel s, GPixel d) { return srcIn(d, s); }
+static inline GPixel blend_srcout(GPixel s, GPixel d) { return srcOut(s, d); }
+static inline GPixel blend_dstout(GPixel s, GPixel d) { return srcOut(d, s); }
+static inline GPixel blend_srcatop(GPixel s, GPixel d) { return srcATop(s, d); }
+static inline GPixel blend_dstatop(GPixel s, GPixel d) { return srcATop(d, s); }
+static inline GPixel blend_xor(GPixel s, GPixel d) { return sdXor(s, d); }
+
+/**
+ *  Rewrites the mode into the cheapest mode that gives the exact same pixels for a src with
+ *  the given alpha (the div255 math is exact at 0 and 255, so these are identities):
+ *
+ *  Sa == 0   : every mode either leaves dst alone (kDst) or zeroes it (kClear)
+ *  Sa == 255 : kSrcOver -> kSrc, kDstIn -> kDst, kDstOut -> kClear, kSrcATop -> kSrcIn,
+ *              kDstATop -> kDstOver, kXor -> kSrcOut
+ */
+static GBlendMode simplify_mode(GBlendMode mode, SrcAlpha alpha)
+{
+    if (alpha == SrcAlpha::kTransparent)
+    {
+        switch (mode)
+        {
+        case GBlendMode::kDst:
+        case GBlendMode::kSrcOver:
+        case GBlendMode::kDstOver:
+        case GBlendMode::kDstOut:
+        case GBlendMode::kSrcATop:
+        case GBlendMode::kXor:
+            return GBlendMode::kDst;
+        default:
+            return GBlendMode::kClear;
+        }
+    }
+    if (alpha == SrcAlpha::kOpaque)
+    {
+        switch (mode)
+        {
+        case GBlendMode::kSrcOver:
+            return GBlendMode::kSrc;
+        case GBlendMode::kDstIn:
+            return GBlendMode::kDst;
+        case GBlendMode::kDstOut:
+            return GBlendMode::kClear;
+        case GBlendMode::kSrcATop:
+            return GBlendMode::kSrcIn;
+        case GBlendMode::kDstATop:
+            return GBlendMode::kDstOver;
+        case GBlendMode::kXor:
+            return GBlendMode::kSrcOut;
+        default:
+            break;
+        }
+    }
+    return mode;
+}
+
+static inline SrcAlpha alpha_of(GPixel src)
+{
+    int a = GPixel_GetA(src);
+    return a == 0 ? SrcAlpha::kTransparent : (a == 255 ? SrcAlpha::kOpaque : SrcAlpha::kUnknown);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// constant src
+
+static void clear_color_row(GPixel dst[], GPixel src, int count)
+{
+    memset(dst, 0, count * sizeof(GPixel));
+}
+
+static void fill_color_row(GPixel dst[], GPixel src, int count)
+{
+    std::fill(dst, dst + count, src);
+}
+
+template <GPixel (*Blend)(GPixel, GPixel)>
+static void blend_color_row(GPixel dst[], GPixel src, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        dst[i] = Blend(src, dst[i]);
+    }
+}
+
+static void srcover_color_row(GPixel dst[], GPixel src, int count)
+{
+    srcover_span(dst, count, src);
+}
+
+// indexed by GBlendMode
+static const ColorRowProc gColorRowProcs[] = {
+    clear_color_row,                   // kClear
+    fill_color_row,                    // kSrc
+    nullptr,                           // kDst
+    srcover_color_row,                 // kSrcOver
+    blend_color_row<blend_dstover>,    // kDstOver
+    blend_color_row<blend_srcin>,      // kSrcIn
+    blend_color_row<blend_dstin>,      // kDstIn
+    blend_color_row<blend_srcout>,     // kSrcOut
+    blend_color_row<blend_dstout>,     // kDstOut
+    blend_color_row<blend_srcatop>,    // kSrcATop
+    blend_color_row<blend_dstatop>,    // kDstATop
+    blend_color_row<blend_xor>,        // kXor
+};
+
+/**
+ *  Pick the row proc for blending a constant src with this mode. Returns nullptr when the
+ *  draw can't change dst (e.g. kDst, or kSrcOver with a transparent src), so the caller can
+ *  skip it entirely.
+ */
+static ColorRowProc choose_color_proc(GBlendMode mode, GPixel src)
+{
+    return gColorRowProcs[(int)simplify_mode(mode, alpha_of(src))];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// row of src pixels
+
+static void clear_shade_row(GPixel dst[], const GPixel src[], int count)
+{
+    memset(dst, 0, count * sizeof(GPixel));
+}
+
+static void copy_shade_row(GPixel dst[], const GPixel src[], int count)
+{
+    memcpy(dst, src, count * sizeof(GPixel));
+}
+
+template <GPixel (*Blend)(GPixel, GPixel)>
+static void blend_shade_row(GPixel dst[], const GPixel src[], int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        dst[i] = Blend(src[i], dst[i]);
+    }
+}
+
+// indexed by GBlendMode
+static const ShadeRowProc gShadeRowProcs[] = {
+    clear_shade_row,                   // kClear
+    copy_shade_row,                    // kSrc
+    nullptr,                           // kDst
+    blend_shade_row<blend_srcover>,    // kSrcOver
+    blend_shade_row<blend_dstover>,    // kDstOver
+    blend_shade_row<blend_srcin>,      // kSrcIn
+    blend_shade_row<blend_dstin>,      // kDstIn
+    blend_shade_row<blend_srcout>,     // kSrcOut
+    blend_shade_row<blend_dstout>,     // kDstOut
+    blend_shade_row<blend_srcatop>,    // kSrcATop
+    blend_shade_row<blend_dstatop>,    // kDstATop
+    blend_shade_row<blend_xor>,        // kXor
+};
+
+/**
+ *  Pick the row proc for blending shaded rows with this mode. opaque is the shader's
+ *  isOpaque(). Returns nullptr when the draw can't change dst.
+ */
+static ShadeRowProc choose_shade_proc(GBlendMode mode, bool opaque)
+{
+    return gShadeRowProcs[(int)simplify_mode(mode, opaque ? SrcAlpha::kOpaque : SrcAlpha::kUnknown)];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// partial coverage (anti-aliasing)
+
+// indexed by GBlendMode
+static const BlendProc gBlendProcs[] = {
+    blend_clear, blend_src, blend_dst, blend_srcover, blend_dstover, blend_srcin,
+    blend_dstin, blend_srcout, blend_dstout, blend_srcatop, blend_dstatop, blend_xor,
+};
+
+// lerp from d to the blended result b by coverage c (0...255)
+static inline GPixel lerp_pixel(GPixel d, GPixel b, unsigned c)
+{
+    unsigned ic = 255 - c;
+    unsigned a = div255(GPixel_GetA(b) * c + GPixel_GetA(d) * ic);
+    unsigned r = div255(GPixel_GetR(b) * c + GPixel_GetR(d) * ic);
+    unsigned g = div255(GPixel_GetG(b) * c + GPixel_GetG(d) * ic);
+    unsigned bl = div255(GPixel_GetB(b) * c + GPixel_GetB(d) * ic);
+    return GPixel_PackARGB(a, r, g, bl);
+}
+
+/**
+ *  Blend src (a constant if srcStride is 0, else a row) into dst, scaling each pixel's result
+ *  by its coverage: dst' = lerp(dst, blend(src, dst), coverage). Only used for the partially
+ *  covered pixels along anti-aliased edges; fully covered runs use the row procs above.
+ */
+static void blend_row_coverage(BlendProc blend, GPixel dst[], const GPixel src[], int srcStride,
+                               const uint8_t coverage[], int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        GPixel s = src[i * srcStride];
+        dst[i] = lerp_pixel(dst[i], blend(s, dst[i]), coverage[i]);
+    }
+}
+
+#endif
@@ -12,11 +12,33 @@
 #include "GMath.h"
 #include <algorithm>
 #include <vector>
+#include <cmath>
+#include <cstdint>
+
+// 16.16 fixed point, for stepping aliased edges: a row's step is an exact integer add, so
+// tall edges don't drift and every compiler rounds them the same way
+typedef int32_t Fixed16;
+
+// pinned to +-32767 pixels, so the result fits in 32 bits (and so floor() can be done by
+// truncating and fixing up negatives, rather than with a call into libm)
+static inline Fixed16 to_fixed16(double v)
+{
+    const double kLimit = 32767.0 * 65536;
+    double r = std::min(std::max(v * 65536, -kLimit), kLimit) + 0.5;
+    Fixed16 t = (Fixed16)r;
+    return t - (r < t ? 1 : 0);
+}
+
+// same as GRoundToInt() on the float value
+static inline int fixed16_round(Fixed16 x)
+{
+    return (x + (1 << 15)) >> 16;
+}
 
 struct Edge
 {
-    float fCurrX;
-    float fSlope;
+    Fixed16 fX;     // x at the center of row fY
+    Fixed16 fDX;    // change in x per row
     int fY;
     int fLastY;
     int fWind = -1; // if p0 < p1
@@ -36,11 +58,10 @@ struct Edge
             // do we ever check this?
             return false;
         }
-        fSlope = (p1.fX - p0.fX) / (p1.fY - p0.fY);
-        // if (fSlope == 0) {
-        //     return false;
-        // }
-        fCurrX = p0.fX + fSlope * (y0 - p0.fY + 0.5f);
+        // in double, so the only rounding is the conversion to fixed point
+        double slope = ((double)p1.fX - p0.fX) / ((double)p1.fY - p0.fY);
+        fX = to_fixed16(p0.fX + slope * (y0 - p0.fY + 0.5));
+        fDX = to_fixed16(slope);
         fY = GRoundToInt(y0);
         fLastY = GRoundToInt(y1 - 1);
         if (fY == fLastY) {
@@ -50,6 +71,34 @@ struct Edge
     }
 };
 
+// edge for anti-aliased (coverage) scan conversion. same winding convention as Edge,
+// but it keeps the exact float endpoints instead of snapping to pixel centers, so
+// edges shorter than a row still count
+struct AAEdge
+{
+    float fX0, fY0; // top
+    float fX1, fY1; // bottom
+    int fWind = -1; // if p0 < p1
+
+    bool init(GPoint p0, GPoint p1)
+    {
+        if (p0.fY > p1.fY)
+        {
+            fWind = 1; // going down
+            std::swap(p0, p1);
+        }
+        if (p0.fY == p1.fY)
+        {
+            return false;
+        }
+        fX0 = p0.fX;
+        fY0 = p0.fY;
+        fX1 = p1.fX;
+        fY1 = p1.fY;
+        return true;
+    }
+};
+
 unsigned div255(unsigned value)
 {
     const unsigned K = 65793;
@@ -157,81 +206,58 @@ GPixel colorToPixel(GColor color)
     return GPixel_PackARGB(a, r, g, b);
 }
 
-GPixel blendme(GBlendMode blmd, GPixel dst, GPixel src)
+/**
+ *  Flattens a curve into n line segments with forward differencing: after the first point, each
+ *  point costs a few adds instead of a polynomial evaluation. Calls line(p0, p1) for each
+ *  segment, in order. The segment count is exactly n, and the last segment ends exactly on the
+ *  curve's end point (the differences drift a little, but the joins with the next segment
+ *  stay watertight).
+ */
+template <typename LineProc>
+void flatten_quad(const GPoint pts[3], int n, LineProc line)
 {
-    // TODO: add shortcuts for when srca is 1 or 0
-    switch (blmd)
-    {
-    case GBlendMode::kClear:
-    {
-        return 0;
-    };
-    case GBlendMode::kSrc:
-    {
-        return src;
-    };
-    case GBlendMode::kDst:
-    {
-        return dst;
-    };
-    case GBlendMode::kSrcOver:
-    {
-        return srcOver(src, dst);
-    };
-    case GBlendMode::kDstOver:
-    {
-        return srcOver(dst, src);
-    };
-    case GBlendMode::kSrcIn:
-    {
-        return srcIn(src, dst);
-    };
-    case GBlendMode::kDstIn:
-    {
-        return srcIn(dst, src);
-    };
-    case GBlendMode::kSrcOut:
-    {
-        return srcOut(src, dst);
-    };
-    case GBlendMode::kDstOut:
-    {
-        return srcOut(dst, src);
-    };
-    case GBlendMode::kSrcATop:
-    {
-        return srcATop(src, dst);
-    };
-    case GBlendMode::kDstATop:
-    {
-        return srcATop(dst, src);
-    };
-    case GBlendMode::kXor:
+    // P(t) = A t^2 + B t + C
+    GPoint A = pts[0] + -2.0f * pts[1] + pts[2];
+    GPoint B = 2.0f * (pts[1] - pts[0]);
+    float h = 1.0f / n;
+
+    GPoint P = pts[0];
+    GPoint D1 = A * (h * h) + B * h;
+    GPoint D2 = A * (2 * h * h);
+    for (int i = 1; i < n; i++)
     {
-        return sdXor(src, dst);
-    };
-    default:
-        break;
+        GPoint next = P + D1;
+        line(P, next);
+        P = next;
+        D1 = D1 + D2;
     }
+    line(P, pts[2]);
 }
 
-GPoint eval_cubic(const GPoint pts[3], float t)
+template <typename LineProc>
+void flatten_cubic(const GPoint pts[4], int n, LineProc line)
 {
+    // P(t) = A t^3 + B t^2 + C t + D
     GPoint A = (pts[3] - pts[0]) + 3.0f * (pts[1] - pts[2]);
     GPoint B = 3.0f * ((pts[2] - pts[1]) + (pts[0] - pts[1]));
     GPoint C = 3.0f * (pts[1] - pts[0]);
-    GPoint D = pts[0];
-    return ((A * t + B) * t + C) * t + D;
-}
+    float h = 1.0f / n;
+    float h2 = h * h;
+    float h3 = h2 * h;
 
-GPoint eval_quad(const GPoint pts[], float t)
-{
-    // std::cout << pts[0].x() << std::endl;
-    GPoint A = pts[0] + -2.0f * pts[1] + pts[2];
-    GPoint B = 2.0f * (pts[1] + (-1.0f) * (pts[0]));
-    GPoint C = pts[0];
-    // std::cout << ((A * t + B) * t + C).x() << std::endl;
-    return (A * t + B) * t + C;
+    GPoint P = pts[0];
+    GPoint D1 = A * h3 + B * h2 + C * h;
+    GPoint D2 = A * (6 * h3) + B * (2 * h2);
+    GPoint D3 = A * (6 * h3);
+    for (int i = 1; i < n; i++)
+    {
+        GPoint next = P + D1;
+        line(P, next);
+        P = next;
+        D1 = D1 + D2;
+        D2 = D2 + D3;
+    }
+    line(P, pts[3]);
 }
 
 int segCount(GPath::Verb v, GPoint pts[])
@@ -10,22 +10,25 @@
 #include <iostream>
 #include "GMath.h"
 #include <algorithm>
-#include <vector>
+#include "scratch_arena.h"
 
-void clip(GPoint &P0, GPoint &P1, std::vector<Edge> &edges, GBitmap device)
+// clips P0..P1 to a w x h device, pinning anything past the right/bottom to maxX/maxY.
+// E is the edge type that gets built from each clipped piece (Edge or AAEdge)
+template <typename E>
+void clip_edges(const GPoint &P0, const GPoint &P1, ScratchArray<E> &edges, int w, int h, float maxX, float maxY)
 {
-    int w = device.width();
-    int h = device.height();
-
     // if ys are same, we can ignore
     if (P0.fY == P1.fY)
     {
         return;
     }
+    // the pieces below get built top/bottom or left/right, so remember which way the
+    // original line went: every piece has to wind the same way it does
+    int wind = P0.fY > P1.fY ? 1 : -1;
     // if all points are inside, just make the edge
     if (P0.fY >= 0 && P0.fX >= 0 && P0.fX < w && P0.fY < h && P1.fY >= 0 && P1.fX >= 0 && P1.fX < w && P1.fY < h)
     {
-        Edge e;
+        E e;
 
         // e.init(P0, P1);
         if (e.init(P0, P1))
@@ -78,12 +81,12 @@ void clip(GPoint &P0, GPoint &P1, std::vector<Edge> &edges, GBitmap device)
             }
             if (top.fX == bottom.fX)
             {
-                bottom.fY = h - 1;
+                bottom.fY = maxY;
             }
             else
             {
                 bottom.fX = bottom.fX - (bottom.fX - top.fX) * ((bottom.fY - (h)) / (bottom.fY - top.fY));
-                bottom.fY = h - 1;
+                bottom.fY = maxY;
             }
         }
 
@@ -109,8 +112,8 @@ void clip(GPoint &P0, GPoint &P1, std::vector<Edge> &edges, GBitmap device)
         }
         if (right.fX >= w && left.fX >= w)
         {
-            right.fX = w - 1;
-            left.fX = w - 1;
+            right.fX = maxX;
+            left.fX = maxX;
         }
         // check left
         if (left.fX < 0)
@@ -120,9 +123,10 @@ void clip(GPoint &P0, GPoint &P1, std::vector<Edge> &edges, GBitmap device)
             QP.fY = left.fY;
             left.fY = left.fY + (right.fY - left.fY) * (-left.fX) / (right.fX - left.fX);
             left.fX = 0;
-            Edge e;
+            E e;
             if (e.init(QP, left))
             {
+                e.fWind = wind;
                 edges.push_back(e);
             }
         }
@@ -130,19 +134,34 @@ void clip(GPoint &P0, GPoint &P1, std::vector<Edge> &edges, GBitmap device)
         if (right.fX > w)
         {
             GPoint QP;
-            QP.fX = w - 1;
+            QP.fX = maxX;
             QP.fY = right.fY;
             right.fY = right.fY - (right.fY - left.fY) * (right.fX - w) / (right.fX - left.fX);
-            right.fX = w - 1;
-            Edge e;
-            if (e.init(QP, right)) {
+            right.fX = maxX;
+            E e;
+            if (e.init(QP, right))
+            {
+                e.fWind = wind;
                 edges.push_back(e);
-            };
+            }
         }
-        Edge e;
+        E e;
         if (e.init(left, right))
         {
+            e.fWind = wind;
             edges.push_back(e);
-        };
+        }
     }
 }
+
+// aliased edges are sampled at pixel centers, so they pin to the last row/column
+void clip(const GPoint &P0, const GPoint &P1, ScratchArray<Edge> &edges, GBitmap device)
+{
+    clip_edges(P0, P1, edges, device.width(), device.height(), device.width() - 1, device.height() - 1);
+}
+
+// coverage edges keep their exact extent, so they pin to the device's far edges
+void clip(const GPoint &P0, const GPoint &P1, ScratchArray<AAEdge> &edges, GBitmap device)
+{
+    clip_edges(P0, P1, edges, device.width(), device.height(), device.width(), device.height());
+}
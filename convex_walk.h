@@ -0,0 +1,172 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef convex_walk_DEFINED
+#define convex_walk_DEFINED
+
+#include "GMath.h"
+#include "GPoint.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// needs Fixed16 / to_fixed16 from claire_utilz.h, so include it after that
+
+// GRoundToInt() without the call into libm for floorf() (the walker only takes points well
+// inside int range)
+static inline int convex_round(float v)
+{
+    float r = v + 0.5f;
+    int t = (int)r;
+    return t - (r < t ? 1 : 0);
+}
+
+/**
+ *  One side of a convex polygon: the run of edges from the top vertex down to the bottom
+ *  one, walked in vertex order (step is +1 or -1). x is the chain's 16.16 x at the center of
+ *  the current row, exactly as Edge::init() and stepping would have it.
+ */
+struct ConvexChain
+{
+    const GPoint *fPts;
+    int fCount;
+    int fStep;
+    int fIndex;      // the current edge runs from fPts[fIndex] to fPts[fNext]
+    int fNext;
+    int fBottom;     // index of the bottom vertex, where the chain ends
+    int fEndY;       // first row past the current edge (the row its bottom rounds to)
+    Fixed16 fX;
+    Fixed16 fDX;
+
+    void init(const GPoint pts[], int count, int step, int top, int bottom)
+    {
+        fPts = pts;
+        fCount = count;
+        fStep = step;
+        fBottom = bottom;
+        fNext = top;
+        fEndY = convex_round(pts[top].fY);
+        fIndex = top;
+    }
+
+    // moves onto the edge that covers row y (skipping any that end above it). false if the
+    // chain has run out
+    bool advanceTo(int y)
+    {
+        while (y >= fEndY)
+        {
+            if (fNext == fBottom)
+            {
+                return false;
+            }
+            fIndex = fNext;
+            fNext += fStep;
+            fNext = fNext == fCount ? 0 : (fNext < 0 ? fCount - 1 : fNext);
+
+            GPoint a = fPts[fIndex];
+            GPoint b = fPts[fNext];
+            int y0 = fEndY; // where the last edge ended
+            fEndY = convex_round(b.fY);
+            if (y0 >= fEndY)
+            {
+                continue; // flat (or less than a row): covers no row centers
+            }
+            double slope = ((double)b.fX - a.fX) / ((double)b.fY - a.fY);
+            fX = to_fixed16(a.fX + slope * (y0 - a.fY + 0.5));
+            fDX = to_fixed16(slope);
+            if (y > y0)
+            {
+                // jumping ahead is exact: it's the same integer adds, all at once
+                fX = (Fixed16)(fX + (int64_t)fDX * (y - y0));
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ *  Fills an aliased convex polygon without building or sorting any edges: find the top and
+ *  bottom vertices, then walk the two chains between them in vertex order, calling
+ *  span(y, x0, x1) for every row in [top, bottom) the polygon covers (x0 <= x1, 16.16).
+ *  Rows above top are skipped analytically instead of stepped through.
+ *
+ *  Returns false, without calling span, for anything this can't walk: non-finite or huge
+ *  (past what 16.16 holds) points, or more than one top and one bottom (i.e. not convex, or
+ *  self-intersecting). The caller should fall back to the general edge path for those.
+ */
+template <typename SpanProc>
+bool walk_convex(const GPoint pts[], int count, int top, int bottom, SpanProc span)
+{
+    const float kLimit = 1 << 14;
+    int topIndex = 0, bottomIndex = 0;
+    for (int i = 0; i < count; i++)
+    {
+        // written so nan fails too
+        if (!(std::abs(pts[i].fX) < kLimit && std::abs(pts[i].fY) < kLimit))
+        {
+            return false;
+        }
+        if (pts[i].fY < pts[topIndex].fY)
+        {
+            topIndex = i;
+        }
+        if (pts[i].fY > pts[bottomIndex].fY)
+        {
+            bottomIndex = i;
+        }
+    }
+
+    // y-monotone both ways round: going all the way round (from an edge that isn't flat,
+    // back to it), y only changes direction at the top and at the bottom
+    int turns = 0;
+    int firstDir = 0, lastDir = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float dy = pts[i + 1 < count ? i + 1 : 0].fY - pts[i].fY;
+        int dir = dy > 0 ? 1 : (dy < 0 ? -1 : 0);
+        if (dir == 0)
+        {
+            continue;
+        }
+        if (firstDir == 0)
+        {
+            firstDir = dir;
+        }
+        turns += lastDir != 0 && dir != lastDir;
+        lastDir = dir;
+    }
+    if (lastDir == 0)
+    {
+        return true; // all flat: no rows
+    }
+    // ... and the turn (if any) from the last edge back round to the first
+    turns += firstDir != lastDir;
+    if (turns > 2)
+    {
+        return false;
+    }
+
+    int y = std::max(convex_round(pts[topIndex].fY), top);
+    int stop = std::min(convex_round(pts[bottomIndex].fY), bottom);
+    if (y >= stop)
+    {
+        return true;
+    }
+    ConvexChain a, b;
+    a.init(pts, count, 1, topIndex, bottomIndex);
+    b.init(pts, count, -1, topIndex, bottomIndex);
+    for (; y < stop; y++)
+    {
+        if (!a.advanceTo(y) || !b.advanceTo(y))
+        {
+            break;
+        }
+        span(y, std::min(a.fX, b.fX), std::max(a.fX, b.fX));
+        a.fX += a.fDX;
+        b.fX += b.fDX;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef edge_cache_DEFINED
+#define edge_cache_DEFINED
+
+#include "GMatrix.h"
+#include "GRect.h"
+#include "scratch_arena.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// needs Edge / AAEdge from claire_utilz.h, so include it after that
+
+enum
+{
+    // bytes a canvas's edge cache holds at most (it has one for aliased edges and one for
+    // anti-aliased edges, each this big)
+    kEdgeCacheBudget = 512 * 1024,
+};
+
+/**
+ *  Where a CTM puts a path, split into whole pixels (dx, dy) and the rest: matrix is the CTM
+ *  with only the fractional part of its translate. Two CTMs with the same matrix place the
+ *  path the same way, up to a whole-pixel offset.
+ *
+ *  Returns false if the translate is too big (or not finite) to split.
+ */
+static bool split_translate(const GMatrix &ctm, GMatrix *matrix, int *dx, int *dy)
+{
+    const float kLimit = 1 << 24;
+    float tx = ctm[GMatrix::TX], ty = ctm[GMatrix::TY];
+    // written so nan fails too
+    if (!(std::abs(tx) < kLimit && std::abs(ty) < kLimit))
+    {
+        return false;
+    }
+    float ix = std::floor(tx), iy = std::floor(ty);
+    *matrix = ctm;
+    // exact: taking a float's integer part off leaves only bits it already had
+    (*matrix)[GMatrix::TX] = tx - ix;
+    (*matrix)[GMatrix::TY] = ty - iy;
+    *dx = (int)ix;
+    *dy = (int)iy;
+    return true;
+}
+
+// true if bounds, moved by (dx, dy), is inside [0, w) x [0, h), where clipping leaves every
+// edge alone
+static inline bool fits_device(const GRect &bounds, int dx, int dy, int w, int h)
+{
+    // written so nan fails too
+    return bounds.fLeft + dx >= 0 && bounds.fTop + dy >= 0 && bounds.fRight + dx < w &&
+           bounds.fBottom + dy < h;
+}
+
+// moves an edge by whole pixels. exact for the 16.16 edges; the float ones can round, but the
+// same way every time
+static inline void offset_edge(Edge &e, int dx, int dy)
+{
+    e.fX += dx * (1 << 16);
+    e.fY += dy;
+    e.fLastY += dy;
+}
+
+static inline void offset_edge(AAEdge &e, int dx, int dy)
+{
+    e.fX0 += dx;
+    e.fX1 += dx;
+    e.fY0 += dy;
+    e.fY1 += dy;
+}
+
+/**
+ *  Device-space edges of recently drawn paths, so drawing the same path again can go straight
+ *  to scan conversion. Entries are keyed by the path's generation ID, the device size and the
+ *  matrix the edges were built with, so a path drawn under several CTMs keeps an entry for
+ *  each. The edges are built in one of two ways:
+ *
+ *  - movable: the path fit inside the device, so nothing was clipped, and its edges were
+ *    built from the CTM with only the fractional part of its translate (plus a whole-pixel
+ *    origin, see MyCanvas::build_movable_edges). Any CTM with the same fractional part is then just a
+ *    whole-pixel offset of those edges, as long as the path still fits.
+ *  - clipped: anything else. These only match the exact CTM they were built with.
+ *
+ *  Either way a hit gives the same edges a rebuild would, so what gets drawn never depends on
+ *  what happens to be in the cache.
+ *
+ *  Least recently used entries are evicted to stay within the byte budget. The entries live in
+ *  one pool, threaded onto the LRU list and onto a hash chain per generation ID by index, and
+ *  an evicted entry is reused (edge storage too) for the one that replaces it. So once the
+ *  cache is full, a miss only touches the heap if the new edges outgrow the storage it reuses.
+ */
+template <typename E>
+class EdgeCache
+{
+public:
+    explicit EdgeCache(size_t budget) : fBuckets(kMinBuckets, -1), fBudget(budget) {}
+
+    // a built path, ready to be added
+    struct Key
+    {
+        uint32_t fGenID;
+        int fWidth, fHeight; // device
+        GMatrix fMatrix;     // the whole CTM if clipped, else without its whole-pixel translate
+        bool fMovable;
+        int fOriginX, fOriginY; // movable: the whole-pixel translate the edges were built at
+        GRect fBounds;          // movable: where the edges' points can be, at that origin
+    };
+
+    /**
+     *  On a hit, appends the path's edges for the CTM to edges and returns true. dx, dy is
+     *  the CTM's whole-pixel translate (from split_translate(), which gave matrix), or ignored
+     *  if split is false.
+     */
+    bool find(uint32_t genID, const GMatrix &ctm, bool split, const GMatrix &matrix, int dx, int dy,
+              int w, int h, ScratchArray<E> &edges)
+    {
+        for (int i = fBuckets[this->bucket(genID)]; i >= 0; i = fEntries[i].fChain)
+        {
+            const Entry &entry = fEntries[i];
+            const Key &key = entry.fKey;
+            if (key.fGenID != genID || key.fWidth != w || key.fHeight != h)
+            {
+                continue;
+            }
+            if (key.fMovable)
+            {
+                int ox = dx - key.fOriginX, oy = dy - key.fOriginY;
+                if (!split || !same_matrix(key.fMatrix, matrix) || !fits_device(key.fBounds, ox, oy, w, h))
+                {
+                    continue;
+                }
+                size_t start = edges.size();
+                edges.append(entry.fEdges.data(), entry.fEdges.data() + entry.fEdges.size());
+                for (size_t k = start; k < edges.size(); k++)
+                {
+                    offset_edge(edges[k], ox, oy);
+                }
+            }
+            else
+            {
+                if (!same_matrix(key.fMatrix, ctm))
+                {
+                    continue;
+                }
+                edges.append(entry.fEdges.data(), entry.fEdges.data() + entry.fEdges.size());
+            }
+            // most recently used at the front
+            this->unlink(i);
+            this->pushFront(i);
+            fHits++;
+            return true;
+        }
+        fMisses++;
+        return false;
+    }
+
+    // stores count edges for the key, which find() has just missed (so no entry has it yet)
+    void add(const Key &key, const E edges[], size_t count)
+    {
+        if (entry_bytes(count) > fBudget)
+        {
+            return;
+        }
+        // make room from the least recently used end, keeping the first entry to go (unless
+        // its storage would mostly sit unused) to hold this one
+        int slot = -1;
+        while (fBytes + entry_bytes(slot < 0 ? count : std::max(count, fEntries[slot].fEdges.capacity())) > fBudget)
+        {
+            int victim = fTail;
+            assert(victim >= 0);
+            this->evict(victim);
+            if (slot < 0 && fEntries[victim].fEdges.capacity() <= 2 * count)
+            {
+                slot = victim;
+            }
+            else
+            {
+                std::vector<E>().swap(fEntries[victim].fEdges);
+                fEntries[victim].fNext = fFree;
+                fFree = victim;
+            }
+        }
+        if (slot < 0)
+        {
+            slot = this->newEntry();
+        }
+
+        Entry &entry = fEntries[slot];
+        entry.fKey = key;
+        entry.fEdges.assign(edges, edges + count);
+        fBytes += entry_bytes(entry.fEdges.capacity());
+        this->pushFront(slot);
+        size_t b = this->bucket(key.fGenID);
+        entry.fChain = fBuckets[b];
+        fBuckets[b] = slot;
+    }
+
+    int64_t hits() const { return fHits; }
+    int64_t misses() const { return fMisses; }
+    size_t bytes() const { return fBytes; }
+    size_t budget() const { return fBudget; }
+
+private:
+    enum
+    {
+        kMinBuckets = 16, // a power of 2, as the bucket count always is
+    };
+
+    // links are indices into fEntries, -1 for none
+    struct Entry
+    {
+        Key fKey;
+        std::vector<E> fEdges;
+        int fPrev, fNext; // the LRU list (fNext also links the free list)
+        int fChain;       // the next entry in the same bucket
+    };
+
+    // what an entry costs against the budget: its edges, plus the entry and its bucket
+    static size_t entry_bytes(size_t capacity)
+    {
+        return capacity * sizeof(E) + sizeof(Entry) + sizeof(int);
+    }
+
+    static bool same_matrix(const GMatrix &a, const GMatrix &b)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            if (a[i] != b[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // generation IDs are handed out in order, so their low bits spread them evenly
+    size_t bucket(uint32_t genID) const
+    {
+        return genID & (fBuckets.size() - 1);
+    }
+
+    void unlink(int i)
+    {
+        Entry &entry = fEntries[i];
+        if (entry.fPrev >= 0)
+        {
+            fEntries[entry.fPrev].fNext = entry.fNext;
+        }
+        else
+        {
+            fHead = entry.fNext;
+        }
+        if (entry.fNext >= 0)
+        {
+            fEntries[entry.fNext].fPrev = entry.fPrev;
+        }
+        else
+        {
+            fTail = entry.fPrev;
+        }
+    }
+
+    void pushFront(int i)
+    {
+        Entry &entry = fEntries[i];
+        entry.fPrev = -1;
+        entry.fNext = fHead;
+        if (fHead >= 0)
+        {
+            fEntries[fHead].fPrev = i;
+        }
+        else
+        {
+            fTail = i;
+        }
+        fHead = i;
+    }
+
+    // takes entry i out of the cache, but leaves it (and its edge storage) in the pool
+    void evict(int i)
+    {
+        this->unlink(i);
+        int *link = &fBuckets[this->bucket(fEntries[i].fKey.fGenID)];
+        while (*link != i)
+        {
+            link = &fEntries[*link].fChain;
+        }
+        *link = fEntries[i].fChain;
+        fBytes -= entry_bytes(fEntries[i].fEdges.capacity());
+    }
+
+    // an unused entry: a free one if there is one, otherwise the pool grows (with about one
+    // bucket per entry)
+    int newEntry()
+    {
+        if (fFree >= 0)
+        {
+            int i = fFree;
+            fFree = fEntries[i].fNext;
+            return i;
+        }
+        fEntries.emplace_back();
+        if (fEntries.size() > fBuckets.size())
+        {
+            fBuckets.assign(2 * fBuckets.size(), -1);
+            for (int i = fHead; i >= 0; i = fEntries[i].fNext)
+            {
+                size_t b = this->bucket(fEntries[i].fKey.fGenID);
+                fEntries[i].fChain = fBuckets[b];
+                fBuckets[b] = i;
+            }
+        }
+        return (int)fEntries.size() - 1;
+    }
+
+    std::vector<Entry> fEntries; // the pool: in the cache, or on the free list
+    std::vector<int> fBuckets;   // the first entry of each hash chain
+    int fHead = -1;              // most recently used
+    int fTail = -1;              // least recently used
+    int fFree = -1;
+    size_t fBudget;
+    size_t fBytes = 0;
+    int64_t fHits = 0;
+    int64_t fMisses = 0;
+};
+
+#endif
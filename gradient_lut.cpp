@@ -0,0 +1,64 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#include "gradient_lut.h"
+#include "GMath.h"
+#include <map>
+#include <mutex>
+#include <utility>
+
+GradientLUT::GradientLUT(const std::vector<GColor> &colors, int size) : fPixels(size)
+{
+    const int count = (int)colors.size();
+    for (int i = 0; i < size; i++)
+    {
+        // which pair of stops entry i falls between, and how far along
+        float fx = (float)i / (size - 1) * (count - 1);
+        int idx = std::min(GFloorToInt(fx), count - 1);
+        const GColor &c0 = colors[idx];
+        const GColor &c1 = colors[std::min(idx + 1, count - 1)];
+        float w = fx - idx;
+
+        float a = c0.a + w * (c1.a - c0.a);
+        float r = c0.r + w * (c1.r - c0.r);
+        float g = c0.g + w * (c1.g - c0.g);
+        float b = c0.b + w * (c1.b - c0.b);
+        fPixels[i] = GPixel_PackARGB(GRoundToInt(a * 255), GRoundToInt(r * a * 255),
+                                     GRoundToInt(g * a * 255), GRoundToInt(b * a * 255));
+    }
+}
+
+std::shared_ptr<const GradientLUT> GradientLUT::Get(const GColor colors[], int count, int size)
+{
+    // stops and size -> the table, if anyone still holds it
+    typedef std::pair<int, std::vector<float>> Key;
+    static std::mutex gMutex;
+    static std::map<Key, std::weak_ptr<const GradientLUT>> gCache;
+
+    Key key;
+    key.first = size;
+    for (int i = 0; i < count; i++)
+    {
+        key.second.insert(key.second.end(), {colors[i].a, colors[i].r, colors[i].g, colors[i].b});
+    }
+
+    std::lock_guard<std::mutex> lock(gMutex);
+    auto iter = gCache.find(key);
+    if (iter != gCache.end())
+    {
+        if (std::shared_ptr<const GradientLUT> lut = iter->second.lock())
+        {
+            return lut;
+        }
+    }
+
+    // drop the tables nobody uses any more before adding another
+    for (auto it = gCache.begin(); it != gCache.end();)
+    {
+        it = it->second.expired() ? gCache.erase(it) : std::next(it);
+    }
+    auto lut = std::make_shared<const GradientLUT>(std::vector<GColor>(colors, colors + count), size);
+    gCache[key] = lut;
+    return lut;
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef gradient_lut_DEFINED
+#define gradient_lut_DEFINED
+
+#include "GColor.h"
+#include "GPixel.h"
+#include "GShader.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ *  A gradient's colors, evenly spaced, lerped, premultiplied and packed into a table of
+ *  GPixels: entry i is the color at t = i / (size - 1). Shading a pixel is then just finding
+ *  its t and loading an entry.
+ *
+ *  Tables are immutable and shared: every gradient with the same stops (and table size) gets
+ *  the same one, for as long as any of them is alive.
+ */
+class GradientLUT
+{
+public:
+    // the table for these stops (count >= 1), with size entries
+    static std::shared_ptr<const GradientLUT> Get(const GColor colors[], int count, int size);
+
+    // enough entries that neighboring pixels along a gradient length pixels long (in device
+    // space) don't land on the same entry, within reason
+    static int SizeFor(float length)
+    {
+        return length <= 256 ? 256 : 1024;
+    }
+
+    GradientLUT(const std::vector<GColor> &colors, int size);
+
+    int size() const { return (int)fPixels.size(); }
+    const GPixel *pixels() const { return fPixels.data(); }
+
+private:
+    std::vector<GPixel> fPixels;
+};
+
+// t in 32.32 fixed point: 1.0 is 1 << 32
+static const int64_t kGradientOne = (int64_t)1 << 32;
+
+/**
+ *  Tiles a 32.32 t into [0, 1] (so [0, kGradientOne]). Every mode is a compare or a mask,
+ *  since the period is a power of two.
+ */
+template <GShader::TileMode TM>
+static inline int64_t tile_gradient(int64_t t)
+{
+    if (TM == GShader::kClamp)
+    {
+        return t < 0 ? 0 : (t > kGradientOne ? kGradientOne : t);
+    }
+    if (TM == GShader::kRepeat)
+    {
+        return t & (kGradientOne - 1);
+    }
+    // mirror: the period is 2, and the second half runs backwards
+    t &= 2 * kGradientOne - 1;
+    return t > kGradientOne ? 2 * kGradientOne - t : t;
+}
+
+// the table entry nearest a tiled t
+static inline int gradient_index(int64_t t, int size)
+{
+    return (int)((t * (size - 1) + (kGradientOne >> 1)) >> 32);
+}
+
+#endif
@@ -7,6 +7,8 @@
 
 #include "GMatrix.h"
 #include "GPaint.h"
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 class GBitmap;
@@ -69,6 +71,61 @@ public:
      */
     virtual void drawPath(const GPath&, const GPaint&) = 0;
 
+    /**
+     *  Fill count rects, each with its own color: the same as calling drawRect(rects[i], paint)
+     *  for each one, in order, with the paint's color set to colors[i]. The paint's blendmode
+     *  and anti-aliasing apply to every rect (its color and shader are ignored).
+     *
+     *  Canvases can set up the draw once for the whole batch, rather than once per rect.
+     */
+    virtual void drawRects(const GRect rects[], const GColor colors[], int count, const GPaint& paint) {
+        GPaint p(paint);
+        p.setShader(nullptr);
+        for (int i = 0; i < count; ++i) {
+            this->drawRect(rects[i], p.setColor(colors[i]));
+        }
+    }
+
+    /**
+     *  Fill count convex polygons, each with its own color, like drawRects(). Polygon i has
+     *  counts[i] points, and the polygons' points are packed one after another in pts.
+     */
+    virtual void drawConvexPolygons(const GPoint pts[], const int counts[], const GColor colors[],
+                                    int count, const GPaint& paint) {
+        GPaint p(paint);
+        p.setShader(nullptr);
+        for (int i = 0; i < count; ++i) {
+            this->drawConvexPolygon(pts, counts[i], p.setColor(colors[i]));
+            pts += counts[i];
+        }
+    }
+
+    /**
+     *  Finish any drawing the canvas has deferred, so the bitmap's pixels are up to date.
+     *  Canvases that draw immediately (e.g. from GCreateCanvas) have nothing to do.
+     */
+    virtual void flush() {}
+
+    /**
+     *  Return true if nothing drawn inside bounds (in local coordinates, i.e. before the CTM is
+     *  applied) could touch any of the canvas's pixels, so a caller may skip drawing it. false
+     *  is always a safe answer, and is what the base class returns.
+     */
+    virtual bool quickReject(const GRect& bounds) const { return false; }
+
+    /**
+     *  Counters for the canvas's cache of device-space path edges, which lets drawPath() skip
+     *  rebuilding a path's edges when the same (unedited) path is drawn again under the same
+     *  CTM, or one that only moves it by whole pixels. Canvases without one report zeros.
+     */
+    struct CacheStats {
+        int64_t fHits = 0;
+        int64_t fMisses = 0;
+        size_t  fBytes = 0;     // held now
+        size_t  fBudget = 0;    // the most it will hold
+    };
+    virtual CacheStats edgeCacheStats() const { return CacheStats(); }
+
     // Helpers
 
     void translate(float x, float y) {
@@ -100,6 +157,17 @@ public:
  */
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& bitmap);
 
+/**
+ *  Like GCreateCanvas, but draws are recorded and then rasterized in parallel, on threadCount
+ *  threads (0 means one per core), when flush() is called or the canvas is destroyed. The
+ *  resulting pixels are identical to GCreateCanvas's.
+ *
+ *  Paths and points are copied when recorded, but shaders are not: a paint's shader must stay
+ *  alive until the next flush(). Threads shade through their own GShader::clone(); a shader
+ *  that returns null from clone() is drawn through by one thread at a time.
+ */
+std::unique_ptr<GCanvas> GCreateTiledCanvas(const GBitmap& bitmap, int threadCount = 0);
+
 /**
  *  Implement this, drawing into the provided canvas, and returning the title of your artwork.
  */
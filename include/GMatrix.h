@@ -115,6 +115,22 @@ public:
         return p;
     }
 
+    /**
+     *  Return the bounds of the rect's 4 corners after they have been mapped by this matrix.
+     */
+    GRect mapRect(const GRect& r) const {
+        GPoint pts[4] = {{r.fLeft, r.fTop}, {r.fRight, r.fTop}, {r.fRight, r.fBottom}, {r.fLeft, r.fBottom}};
+        this->mapPoints(pts, 4);
+        GRect bounds = GRect::LTRB(pts[0].fX, pts[0].fY, pts[0].fX, pts[0].fY);
+        for (int i = 1; i < 4; ++i) {
+            bounds.fLeft   = pts[i].fX < bounds.fLeft   ? pts[i].fX : bounds.fLeft;
+            bounds.fTop    = pts[i].fY < bounds.fTop    ? pts[i].fY : bounds.fTop;
+            bounds.fRight  = pts[i].fX > bounds.fRight  ? pts[i].fX : bounds.fRight;
+            bounds.fBottom = pts[i].fY > bounds.fBottom ? pts[i].fY : bounds.fBottom;
+        }
+        return bounds;
+    }
+
 private:
     float fMat[6];
 };
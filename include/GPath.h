@@ -1,6 +1,9 @@
 #ifndef GPath_DEFINED
 #define GPath_DEFINED
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include "GMatrix.h"
 #include "GPoint.h"
@@ -11,7 +14,26 @@ public:
     GPath();
     ~GPath();
 
+    /**
+     *  Copies are cheap: they share the same points and verbs until one of them is edited,
+     *  and only then does that one make its own copy (copy-on-write). A moved-from path is
+     *  left empty.
+     */
+    GPath(const GPath&) = default;
+    GPath(GPath&&) = default;
     GPath& operator=(const GPath&);
+    GPath& operator=(GPath&&) = default;
+
+    /**
+     *  Make room for this many points and verbs in total, so that building a path of known
+     *  size doesn't reallocate as it grows.
+     */
+    GPath& reserve(int pointCount, int verbCount) {
+        Data& data = this->edit();
+        data.fPts.reserve(pointCount);
+        data.fVbs.reserve(verbCount);
+        return *this;
+    }
 
     /**
      *  Erase any previously added points/verbs, restoring the path to its initial empty state.
@@ -23,8 +45,9 @@ public:
      *  Returns a reference to this path.
      */
     GPath& moveTo(GPoint p) {
-        fPts.push_back(p);
-        fVbs.push_back(kMove);
+        Data& data = this->edit();
+        data.fPts.push_back(p);
+        data.fVbs.push_back(kMove);
         return *this;
     }
     GPath& moveTo(float x, float y) { return this->moveTo({x, y}); }
@@ -35,9 +58,10 @@ public:
      *  Returns a reference to this path.
      */
     GPath& lineTo(GPoint p) {
-        assert(fVbs.size() > 0);
-        fPts.push_back(p);
-        fVbs.push_back(kLine);
+        Data& data = this->edit();
+        assert(data.fVbs.size() > 0);
+        data.fPts.push_back(p);
+        data.fVbs.push_back(kLine);
         return *this;
     }
     GPath& lineTo(float x, float y) { return this->lineTo({x, y}); }
@@ -91,20 +115,46 @@ public:
      */
     GPath& addCircle(GPoint center, float radius, Direction = kCW_Direction);
 
-    int countPoints() const { return (int)fPts.size(); }
+    int countPoints() const { return fData ? (int)fData->fPts.size() : 0; }
+
+    /**
+     *  An ID for the path's current points and verbs, for caching things derived from them.
+     *  Copies share it (they share the points), and editing a path gives it a new one, so two
+     *  paths with the same ID always have the same contents. An empty path that has never been
+     *  edited returns 0, which no other path ever does.
+     */
+    uint32_t getGenerationID() const;
 
     /**
      *  Return the bounds of all of the control-points in the path.
      *
      *  If there are no points, returns an empty rect (all zeros)
+     *
+     *  Computed once, then kept (and shared by copies) until the path is edited.
      */
     GRect bounds() const;
 
+    /**
+     *  Return the smallest rect containing the path itself: like bounds(), but curves only
+     *  count as far as they actually reach, not their off-curve control points.
+     *
+     *  If there are no points, returns an empty rect (all zeros). Not cached: this walks the
+     *  path every time.
+     */
+    GRect computeTightBounds() const;
+
     /**
      *  Transform the path in-place by the specified matrix.
      */
     void transform(const GMatrix&);
 
+    /**
+     *  Store a copy of this path, transformed by the matrix, in dst. If dst isn't sharing its
+     *  storage, that storage is reused, so transforming into the same dst over and over
+     *  doesn't allocate once it is big enough.
+     */
+    void transform(const GMatrix&, GPath* dst) const;
+
     void offset(float dx, float dy) {
         this->transform(GMatrix::Translate(dx, dy));
     }
@@ -166,14 +216,25 @@ public:
     class Edger {
     public:
         Edger(const GPath&);
+
+        /**
+         *  Same, but each point next() returns is first mapped by the matrix. This walks the
+         *  path as if it had been transformed, without copying or transforming the path.
+         */
+        Edger(const GPath&, const GMatrix&);
+
         Verb next(GPoint pts[]);
 
     private:
+        Verb nextUnmapped(GPoint pts[]);
+
         const GPoint* fPrevMove;
         const GPoint* fCurrPt;
         const Verb*   fCurrVb;
         const Verb*   fStopVb;
         Verb fPrevVerb;
+        GMatrix fMatrix;
+        bool fMapPoints;
     };
 
     /**
@@ -195,8 +256,39 @@ public:
     void dump() const;
 
 private:
-    std::vector<GPoint> fPts;
-    std::vector<Verb>   fVbs;
+    struct Data {
+        Data() {}
+        // a copy is about to be edited, so it doesn't keep the ID (or the bounds)
+        Data(const Data& src) : fPts(src.fPts), fVbs(src.fVbs) {}
+
+        std::vector<GPoint> fPts;
+        std::vector<Verb>   fVbs;
+        // 0 until getGenerationID() hands one out, and back to 0 on every edit. atomic because
+        // copies of one path can be asked for it on several threads at once
+        std::atomic<uint32_t> fGenID{0};
+
+        // bounds() of the points, once fBoundsState is kBoundsReady. the first thread to
+        // compute them stores them; any others racing it just return their own
+        enum { kBoundsUnknown, kBoundsStoring, kBoundsReady };
+        GRect fBounds;
+        std::atomic<int> fBoundsState{kBoundsUnknown};
+    };
+    // nullptr means empty, so new (and moved-from) paths don't allocate
+    std::shared_ptr<Data> fData;
+
+    const Data& data() const;
+
+    // the storage, ready to be modified: made if we have none, copied if it is shared
+    Data& edit() {
+        if (!fData) {
+            fData = std::make_shared<Data>();
+        } else if (fData.use_count() > 1) {
+            fData = std::make_shared<Data>(*fData);
+        }
+        fData->fGenID.store(0, std::memory_order_relaxed);
+        fData->fBoundsState.store(Data::kBoundsUnknown, std::memory_order_relaxed);
+        return *fData;
+    }
 };
 
 #endif
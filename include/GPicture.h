@@ -0,0 +1,75 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef GPicture_DEFINED
+#define GPicture_DEFINED
+
+#include "GCanvas.h"
+#include "GRect.h"
+#include <memory>
+#include <vector>
+
+/**
+ *  An immutable recording of GCanvas calls (save/restore/concat and the draws), that can be
+ *  played back into any canvas any number of times.
+ *
+ *  Every op, with its paint and any points or path data, is packed into one contiguous buffer.
+ *  Each draw also stores its bounds (in the coordinates it was drawn in), so playback can skip
+ *  the draws that the target canvas says can't land on it (see GCanvas::quickReject).
+ *
+ *  Paints' shaders are not copied: they must stay alive for as long as the picture is played.
+ */
+class GPicture {
+public:
+    /**
+     *  Issue the recorded calls to canvas, in order, skipping draws that are entirely outside
+     *  of it. The calls are wrapped in a save/restore, so canvas's CTM is unchanged afterwards.
+     */
+    void playback(GCanvas* canvas) const;
+
+    // number of recorded ops (including save/restore/concat)
+    int countOps() const { return fOpCount; }
+
+    // size of the recording, in bytes
+    size_t bytesUsed() const { return fData.size(); }
+
+private:
+    GPicture(std::vector<char>&& data, int opCount) : fData(std::move(data)), fOpCount(opCount) {}
+
+    std::vector<char>   fData;
+    int                 fOpCount;
+
+    friend class GPictureRecorder;
+};
+
+/**
+ *  Records into a GPicture:
+ *
+ *      GPictureRecorder recorder;
+ *      GCanvas* canvas = recorder.beginRecording();
+ *      ... draw into canvas
+ *      std::unique_ptr<GPicture> picture = recorder.finishRecording();
+ */
+class GPictureRecorder {
+public:
+    GPictureRecorder();
+    ~GPictureRecorder();
+
+    /**
+     *  Start a new recording, and return the canvas to record into. The canvas is owned by the
+     *  recorder, and is only valid until finishRecording() is called.
+     */
+    GCanvas* beginRecording();
+
+    /**
+     *  Stop recording and return what was drawn, or nullptr if beginRecording() wasn't called.
+     *  Any saves left open are closed off with restores.
+     */
+    std::unique_ptr<GPicture> finishRecording();
+
+private:
+    std::unique_ptr<GCanvas> fCanvas;
+};
+
+#endif
@@ -12,6 +12,7 @@
 
 class GBitmap;
 class GMatrix;
+class RasterPipeline;
 
 /**
  *  GShaders create colors to fill whatever geometry is being drawn to a GCanvas.
@@ -24,6 +25,13 @@ public:
         kMirror,
     };
 
+    // how a bitmap shader picks the color for a pixel
+    enum Sampling {
+        kNearest,   // the src pixel the device pixel's center lands in
+        kBilinear,  // blend of the 4 src pixels around it
+        kMipmap,    // bilinear, from a prefiltered copy of the src sized to the draw's scale
+    };
+
     virtual ~GShader() {}
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
@@ -38,14 +46,34 @@ public:
      *  can hold at least [count] entries.
      */
     virtual void shadeRow(int x, int y, int count, GPixel row[]) = 0;
+
+    /**
+     *  Optionally, append stages to p that turn its (device space) x, y lanes into premul
+     *  float colors: the ones shadeRow() would make, at float precision. Called after
+     *  setContext(), and the stages may read the state it set up. Return false (the default)
+     *  to have the canvas call shadeRow() instead.
+     */
+    virtual bool appendStages(RasterPipeline* p) { return false; }
+
+    /**
+     *  Optionally, return a shader that draws exactly what this one does but keeps its own
+     *  context, so the two can be set up and shaded on different threads at the same time.
+     *  Return null (the default) if the shader can't be copied.
+     */
+    virtual std::unique_ptr<GShader> clone() const { return nullptr; }
 };
 
 /**
  *  Return a subclass of GShader that draws the specified bitmap and a local matrix.
  *  Returns null if the either parameter is invalid.
+ *
+ *  With kMipmap, the shader builds a pyramid of half-size copies of the bitmap the first time
+ *  it is drawn minified, and each draw then reads from the level matching its scale. The
+ *  pyramid is a snapshot: later changes to the bitmap's pixels won't show up in it.
  */
 std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap&, const GMatrix& localMatrix,
-                                             GShader::TileMode = GShader::kClamp);
+                                             GShader::TileMode = GShader::kClamp,
+                                             GShader::Sampling = GShader::kNearest);
 
 /**
  *  Return a subclass of GShader that draws the specified gradient of [count] colors between
@@ -68,4 +96,14 @@ GCreateLinearGradient(GPoint p0, GPoint p1,
     const GColor colors[] = { c0, c1 };
     return GCreateLinearGradient(p0, p1, colors, 2, mode);
 }
+
+/**
+ *  Return a subclass of GShader that draws the specified gradient of [count] colors in rings
+ *  around center: Color[0] is at center, Color[count-1] is at distance radius from it, and all
+ *  intermediate colors are evenly spaced between. The tile mode says what happens past radius.
+ *
+ *  If count < 1 or radius <= 0, this should return nullptr.
+ */
+std::unique_ptr<GShader> GCreateRadialGradient(GPoint center, float radius, const GColor[],
+                                               int count, GShader::TileMode = GShader::kClamp);
 #endif
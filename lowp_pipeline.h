@@ -0,0 +1,283 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef lowp_pipeline_DEFINED
+#define lowp_pipeline_DEFINED
+
+#include "GBlendMode.h"
+#include "GPixel.h"
+#include "GShader.h"
+#include "raster_pipeline.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+/**
+ *  The low precision sibling of RasterPipeline, for the common case of 8-bit premul pixels
+ *  and blend modes that only need one product per term:
+ *
+ *      [uniform color | shader's 8-bit row] -> [load dst -> blend] -> [coverage] -> store
+ *
+ *  Each channel is a 16-bit lane (a product of two bytes fits), and run() handles
+ *  kLowpLanes pixels per iteration. With 16 lanes of 16 bits, a channel fills one 256-bit
+ *  register (or two sse2 ones) and the compiler keeps every stage in vector registers.
+ *
+ *  The math is the same as the 8-bit row procs in blend_procs.h (same products, same
+ *  rounding), so switching a draw between the two paths doesn't change a single pixel.
+ */
+enum
+{
+    kLowpLanes = 16
+};
+
+struct LowpLanes
+{
+    uint16_t r[kLowpLanes], g[kLowpLanes], b[kLowpLanes], a[kLowpLanes];     // src
+    uint16_t dr[kLowpLanes], dg[kLowpLanes], db[kLowpLanes], da[kLowpLanes]; // dst
+
+    int dx, dy;               // device coordinates of lane 0
+    int n;                    // live lanes
+    GPixel *dst;              // dst pixel of lane 0
+    const uint8_t *coverage;  // coverage of lane 0, or nullptr if the span is fully covered
+    const GPixel *src;        // shaded src pixel of lane 0 (if the pipeline has a shader)
+    GPixel color;             // the pipeline's uniform color
+};
+
+typedef void (*LowpStageFn)(LowpLanes &p, const void *ctx);
+
+class LowpPipeline
+{
+public:
+    // ctx must stay alive (and unchanged) for as long as the pipeline is run
+    void append(LowpStageFn fn, const void *ctx = nullptr)
+    {
+        assert(fCount < kMaxStages);
+        fStages[fCount].fFn = fn;
+        fStages[fCount].fCtx = ctx;
+        fCount++;
+    }
+
+    // the color lowp_uniform_color loads. it's kept by value (not as a stage's ctx), so the
+    // pipeline can be copied around with the blitter that owns it
+    void setColor(GPixel color)
+    {
+        fColor = color;
+    }
+
+    // the shader lowp_load_src reads from. its shadeRow() is called once per block of
+    // kShadeBlock pixels rather than per kLowpLanes, so its per-call setup stays cheap
+    void setShader(GShader *shader)
+    {
+        fShader = shader;
+    }
+
+    // same as RasterPipeline::run()
+    void run(int x, int y, int count, GPixel dst[], const uint8_t coverage[]) const
+    {
+        LowpLanes p;
+        p.dy = y;
+        p.color = fColor;
+        GPixel block[kShadeBlock];
+        for (int blockStart = 0; blockStart < count; blockStart += kShadeBlock)
+        {
+            int blockCount = std::min(count - blockStart, (int)kShadeBlock);
+            if (fShader != nullptr)
+            {
+                fShader->shadeRow(x + blockStart, y, blockCount, block);
+            }
+            for (int start = 0; start < blockCount; start += kLowpLanes)
+            {
+                int offset = blockStart + start;
+                p.dx = x + offset;
+                p.n = std::min(blockCount - start, (int)kLowpLanes);
+                p.dst = dst + offset;
+                p.coverage = coverage != nullptr ? coverage + offset : nullptr;
+                p.src = block + start;
+                for (int i = 0; i < fCount; i++)
+                {
+                    fStages[i].fFn(p, fStages[i].fCtx);
+                }
+            }
+        }
+    }
+
+private:
+    enum
+    {
+        kMaxStages = 8,
+        kShadeBlock = 256,
+    };
+    struct Stage
+    {
+        LowpStageFn fFn;
+        const void *fCtx;
+    };
+    Stage fStages[kMaxStages];
+    int fCount = 0;
+    GPixel fColor = 0;
+    GShader *fShader = nullptr;
+};
+
+/**
+ *  div255() from claire_utilz.h without the 32-bit multiply: for v <= 255 * 255,
+ *
+ *      (v * 65793 + (1 << 23)) >> 24  ==  ((v + 128) * 257) >> 16  ==  (t + (t >> 8)) >> 8
+ *
+ *  with t = v + 128. Every step of the last form fits in 16 bits, so it vectorizes as adds
+ *  and shifts on 16-bit lanes.
+ */
+static inline uint16_t lowp_div255(uint16_t v)
+{
+    uint16_t t = (uint16_t)(v + 128);
+    return (uint16_t)((uint16_t)(t + (t >> 8)) >> 8);
+}
+
+static inline void lowp_unpack_lanes(const GPixel px[], uint16_t r[], uint16_t g[], uint16_t b[], uint16_t a[])
+{
+    for (int i = 0; i < kLowpLanes; i++)
+    {
+        r[i] = (uint16_t)((px[i] >> GPIXEL_SHIFT_R) & 0xFF);
+        g[i] = (uint16_t)((px[i] >> GPIXEL_SHIFT_G) & 0xFF);
+        b[i] = (uint16_t)((px[i] >> GPIXEL_SHIFT_B) & 0xFF);
+        a[i] = (uint16_t)((px[i] >> GPIXEL_SHIFT_A) & 0xFF);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// src
+
+static void lowp_uniform_color(LowpLanes &p, const void *)
+{
+    uint16_t r = GPixel_GetR(p.color), g = GPixel_GetG(p.color);
+    uint16_t b = GPixel_GetB(p.color), a = GPixel_GetA(p.color);
+    for (int i = 0; i < kLowpLanes; i++)
+    {
+        p.r[i] = r;
+        p.g[i] = g;
+        p.b[i] = b;
+        p.a[i] = a;
+    }
+}
+
+// the pixels the pipeline's shader made (with its own fixed point shadeRow())
+static void lowp_load_src(LowpLanes &p, const void *)
+{
+    if (p.n == kLowpLanes)
+    {
+        lowp_unpack_lanes(p.src, p.r, p.g, p.b, p.a);
+        return;
+    }
+    GPixel px[kLowpLanes] = {};
+    std::copy(p.src, p.src + p.n, px);
+    lowp_unpack_lanes(px, p.r, p.g, p.b, p.a);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// dst
+
+static void lowp_load_dst(LowpLanes &p, const void *)
+{
+    if (p.n == kLowpLanes)
+    {
+        lowp_unpack_lanes(p.dst, p.dr, p.dg, p.db, p.da);
+        return;
+    }
+    GPixel px[kLowpLanes] = {};
+    std::copy(p.dst, p.dst + p.n, px);
+    lowp_unpack_lanes(px, p.dr, p.dg, p.db, p.da);
+}
+
+// one term of S * Fs + D * Fd (see BlendFactor). kOne skips the multiply (and its rounding),
+// exactly as the 8-bit procs do
+template <BlendFactor F>
+static inline uint16_t lowp_term(uint16_t c, uint16_t sa, uint16_t da)
+{
+    return F == BlendFactor::kZero    ? 0
+           : F == BlendFactor::kOne   ? c
+           : F == BlendFactor::kSa    ? lowp_div255((uint16_t)(c * sa))
+           : F == BlendFactor::kDa    ? lowp_div255((uint16_t)(c * da))
+           : F == BlendFactor::kInvSa ? lowp_div255((uint16_t)(c * (255 - sa)))
+                                      : lowp_div255((uint16_t)(c * (255 - da)));
+}
+
+template <BlendFactor Fs, BlendFactor Fd>
+static void lowp_blend(LowpLanes &p, const void *)
+{
+    for (int i = 0; i < kLowpLanes; i++)
+    {
+        uint16_t sa = p.a[i], da = p.da[i];
+        p.r[i] = (uint16_t)(lowp_term<Fs>(p.r[i], sa, da) + lowp_term<Fd>(p.dr[i], sa, da));
+        p.g[i] = (uint16_t)(lowp_term<Fs>(p.g[i], sa, da) + lowp_term<Fd>(p.dg[i], sa, da));
+        p.b[i] = (uint16_t)(lowp_term<Fs>(p.b[i], sa, da) + lowp_term<Fd>(p.db[i], sa, da));
+        p.a[i] = (uint16_t)(lowp_term<Fs>(sa, sa, da) + lowp_term<Fd>(da, sa, da));
+    }
+}
+
+/**
+ *  Indexed by GBlendMode. kSrcATop, kDstATop and kXor add two rounded products, which the
+ *  float pipeline does better, so lowp leaves them out (nullptr); see lowp_blend_stage().
+ */
+static const LowpStageFn gLowpBlendStages[] = {
+    lowp_blend<BlendFactor::kZero, BlendFactor::kZero>,  // kClear
+    lowp_blend<BlendFactor::kOne, BlendFactor::kZero>,   // kSrc
+    lowp_blend<BlendFactor::kZero, BlendFactor::kOne>,   // kDst
+    lowp_blend<BlendFactor::kOne, BlendFactor::kInvSa>,  // kSrcOver
+    lowp_blend<BlendFactor::kInvDa, BlendFactor::kOne>,  // kDstOver
+    lowp_blend<BlendFactor::kDa, BlendFactor::kZero>,    // kSrcIn
+    lowp_blend<BlendFactor::kZero, BlendFactor::kSa>,    // kDstIn
+    lowp_blend<BlendFactor::kInvDa, BlendFactor::kZero>, // kSrcOut
+    lowp_blend<BlendFactor::kZero, BlendFactor::kInvSa>, // kDstOut
+    nullptr,                                             // kSrcATop
+    nullptr,                                             // kDstATop
+    nullptr,                                             // kXor
+};
+
+// the blend stage for mode, or nullptr if lowp can't do it
+static LowpStageFn lowp_blend_stage(GBlendMode mode)
+{
+    return gLowpBlendStages[(int)mode];
+}
+
+// result = lerp(dst, result, coverage), rounded the same way as lerp_pixel()
+static void lowp_lerp_coverage(LowpLanes &p, const void *)
+{
+    if (p.coverage == nullptr)
+    {
+        return;
+    }
+    uint16_t c[kLowpLanes] = {};
+    std::copy(p.coverage, p.coverage + p.n, c);
+    for (int i = 0; i < kLowpLanes; i++)
+    {
+        uint16_t ic = (uint16_t)(255 - c[i]);
+        p.r[i] = lowp_div255((uint16_t)(p.r[i] * c[i] + p.dr[i] * ic));
+        p.g[i] = lowp_div255((uint16_t)(p.g[i] * c[i] + p.dg[i] * ic));
+        p.b[i] = lowp_div255((uint16_t)(p.b[i] * c[i] + p.db[i] * ic));
+        p.a[i] = lowp_div255((uint16_t)(p.a[i] * c[i] + p.da[i] * ic));
+    }
+}
+
+static inline void lowp_pack_lanes(const LowpLanes &p, GPixel px[])
+{
+    for (int i = 0; i < kLowpLanes; i++)
+    {
+        px[i] = ((GPixel)p.a[i] << GPIXEL_SHIFT_A) | ((GPixel)p.r[i] << GPIXEL_SHIFT_R) |
+                ((GPixel)p.g[i] << GPIXEL_SHIFT_G) | ((GPixel)p.b[i] << GPIXEL_SHIFT_B);
+    }
+}
+
+// full chunks pack straight into dst, short ones go through a copy
+static void lowp_store(LowpLanes &p, const void *)
+{
+    if (p.n == kLowpLanes)
+    {
+        lowp_pack_lanes(p, p.dst);
+        return;
+    }
+    GPixel px[kLowpLanes];
+    lowp_pack_lanes(p, px);
+    std::copy(px, px + p.n, p.dst);
+}
+
+#endif
@@ -13,6 +13,16 @@
 #include "GPixel.h"
 #include "claire_utilz.h"
 #include "clip.h"
+#include "span_blit.h"
+#include "blend_procs.h"
+#include "raster_pipeline.h"
+#include "lowp_pipeline.h"
+#include "aa_scan.h"
+#include "active_edges.h"
+#include "convex_walk.h"
+#include "edge_cache.h"
+#include "rect_blit.h"
+#include "scratch_arena.h"
 #include <iostream>
 #include "GMath.h"
 #include <algorithm>
@@ -21,239 +31,711 @@
 class MyCanvas : public GCanvas
 {
 public:
-    MyCanvas(const GBitmap &device) : fDevice(device)
+    MyCanvas(const GBitmap &device) : MyCanvas(device, 0, device.height()) {}
+
+    // only touches rows [top, bottom) -- one band of a tiled canvas. everything else
+    // (edge stepping, shader math) runs exactly as for the whole bitmap, so the band's
+    // pixels come out the same as if the whole thing had been drawn at once
+    MyCanvas(const GBitmap &device, int top, int bottom)
+        : fDevice(device), fTop(top), fBottom(bottom)
     {
         GMatrix starter_mx = GMatrix();
         stack.push_back(starter_mx);
     }
 
+    // bytes of scratch the canvas keeps between draws (in use or not)
+    size_t scratchBytes() const
+    {
+        return fScratch.capacity();
+    }
+
+    // everything blit() needs for one draw, picked once per draw call. this is also the draw's
+    // shading context: the shader's context (the inverse of CTM * local matrix, and whatever
+    // the shader derives from it) is set up once, here, and every span of the draw reuses it
+    struct Blitter
+    {
+        GShader *shader;
+        GPixel src;
+        GBlendMode mode;
+        ColorRowProc colorProc;
+        ShadeRowProc shadeProc;
+        RasterPipeline pipeline; // float, for the draws lowp can't do exactly enough
+        LowpPipeline lowp;       // 16-bit lanes
+        bool usePipeline = false;
+        bool useLowp = false;
+        bool lowpColorRows = false; // full color rows go through lowp instead of colorProc
+
+        // swaps in another color with the same alpha class (see alpha_of()) as the one it was
+        // made for: the row proc and lowp stages only depend on the class, not the color
+        void setColor(GPixel color)
+        {
+            assert(shader == nullptr && alpha_of(color) == alpha_of(src));
+            src = color;
+            lowp.setColor(color);
+        }
+
+        // true if the draw can't change any pixels, so we can skip it
+        bool isNop() const
+        {
+            return shader != nullptr ? shadeProc == nullptr : colorProc == nullptr;
+        }
+
+        // blends the color into count pixels starting at (x, y). coverage (if not null) is
+        // lined up with dst
+        void colorSpan(int x, int y, int count, GPixel dst[], const uint8_t coverage[] = nullptr) const
+        {
+            if (coverage == nullptr && !lowpColorRows)
+            {
+                colorProc(dst, src, count);
+            }
+            else if (useLowp)
+            {
+                lowp.run(x, y, count, dst, coverage);
+            }
+            else
+            {
+                blend_row_coverage(gBlendProcs[(int)mode], dst, &src, 0, coverage, count);
+            }
+        }
+
+        // shades count pixels starting at (x, y) and blends them into dst. when the blend is a
+        // plain copy (kSrc, or kSrcOver with an opaque shader), the shader writes straight into
+        // dst
+        void shadeSpan(int x, int y, int count, GPixel dst[], const uint8_t coverage[] = nullptr) const
+        {
+            if (useLowp)
+            {
+                lowp.run(x, y, count, dst, coverage);
+            }
+            else if (usePipeline)
+            {
+                pipeline.run(x, y, count, dst, coverage);
+            }
+            else
+            {
+                assert(shadeProc == copy_shade_row && coverage == nullptr);
+                shader->shadeRow(x, y, count, dst);
+            }
+        }
+    };
+
+    Blitter makeBlitter(const GPaint &paint) const
+    {
+        Blitter blitter;
+        blitter.shader = paint.getShader();
+        blitter.src = colorToPixel(paint.getColor());
+        blitter.mode = paint.getBlendMode();
+        blitter.colorProc = nullptr;
+        blitter.shadeProc = nullptr;
+        if (blitter.shader != nullptr)
+        {
+            // a CTM the shader can't invert means there is nothing to shade
+            if (blitter.shader->setContext(stack.back()))
+            {
+                bool opaque = blitter.shader->isOpaque() && paint.getAlpha() >= 1;
+                blitter.shadeProc = choose_shade_proc(paint.getBlendMode(), opaque);
+                GBlendMode mode = simplify_mode(paint.getBlendMode(), opaque ? SrcAlpha::kOpaque : SrcAlpha::kUnknown);
+                bool coverage = paint.isAntiAlias();
+                if (blitter.shadeProc == nullptr || (mode == GBlendMode::kSrc && !coverage))
+                {
+                    // nothing to draw, or the shader can write straight into dst
+                }
+                else if (paint.getAlpha() >= 1 && lowp_blend_stage(mode) != nullptr)
+                {
+                    blitter.lowp.setShader(blitter.shader);
+                    blitter.lowp.append(lowp_load_src);
+                    append_lowp_blend(&blitter.lowp, mode, coverage);
+                    blitter.useLowp = true;
+                }
+                else
+                {
+                    // paint alpha would round the shader's 8-bit pixels a second time
+                    build_pipeline(&blitter.pipeline, paint, opaque);
+                    blitter.usePipeline = true;
+                }
+            }
+        }
+        else
+        {
+            blitter.colorProc = choose_color_proc(paint.getBlendMode(), blitter.src);
+            GBlendMode mode = simplify_mode(paint.getBlendMode(), alpha_of(blitter.src));
+            if (blitter.colorProc != nullptr && lowp_blend_stage(mode) != nullptr)
+            {
+                blitter.lowp.setColor(blitter.src);
+                blitter.lowp.append(lowp_uniform_color);
+                append_lowp_blend(&blitter.lowp, mode, true);
+                blitter.useLowp = true;
+                // clear, src and srcover already have dedicated row kernels
+                blitter.lowpColorRows = mode != GBlendMode::kClear && mode != GBlendMode::kSrc &&
+                                        mode != GBlendMode::kSrcOver;
+            }
+        }
+        return blitter;
+    }
+
+    /**
+     *  The blitters for a batch of color draws (drawRects(), drawConvexPolygons()). The draws
+     *  only differ in their colors, so this makes at most one blitter for each alpha class
+     *  (transparent, opaque, in between), the first time a color of that class comes up, and
+     *  after that just swaps each draw's color into it.
+     */
+    class BatchBlitters
+    {
+    public:
+        BatchBlitters(const MyCanvas *canvas, const GPaint &paint) : fCanvas(canvas), fPaint(paint)
+        {
+            fPaint.setShader(nullptr);
+        }
+
+        const Blitter &forColor(const GColor &color)
+        {
+            GPixel src = colorToPixel(color);
+            int kind = (int)alpha_of(src);
+            if (!fMade[kind])
+            {
+                fBlitters[kind] = fCanvas->makeBlitter(fPaint.setColor(color));
+                fMade[kind] = true;
+            }
+            else
+            {
+                fBlitters[kind].setColor(src);
+            }
+            return fBlitters[kind];
+        }
+
+    private:
+        const MyCanvas *fCanvas;
+        GPaint fPaint;
+        Blitter fBlitters[3];
+        bool fMade[3] = {false, false, false};
+    };
+
+    // load dst -> blend -> [coverage] -> store, after the lowp pipeline's src stage
+    static void append_lowp_blend(LowpPipeline *p, GBlendMode mode, bool coverage)
+    {
+        p->append(lowp_load_dst);
+        p->append(lowp_blend_stage(mode));
+        if (coverage)
+        {
+            p->append(lowp_lerp_coverage);
+        }
+        p->append(lowp_store);
+    }
+
+    /**
+     *  Compiles a shaded draw into p:
+     *
+     *      device coords -> shader -> [paint alpha] -> [load dst -> blend] -> [coverage] -> store
+     *
+     *  Shaders without stages of their own get one that calls their shadeRow(). The blend is
+     *  left out when it's a plain store (kSrc, or kSrcOver with an opaque src), unless the
+     *  draw is anti-aliased and partial coverage needs dst anyway. The stages point at paint,
+     *  so the pipeline is only good for the draw call it was built for.
+     */
+    static void build_pipeline(RasterPipeline *p, const GPaint &paint, bool opaque)
+    {
+        GShader *shader = paint.getShader();
+        p->append(stage_seed_device_coords);
+        if (!shader->appendStages(p))
+        {
+            p->append(stage_shade_row, shader);
+        }
+        if (paint.getAlpha() < 1)
+        {
+            p->append(stage_scale_alpha, &paint.getColor().a);
+        }
+
+        GBlendMode mode = simplify_mode(paint.getBlendMode(), opaque ? SrcAlpha::kOpaque : SrcAlpha::kUnknown);
+        bool coverage = paint.isAntiAlias();
+        if (mode != GBlendMode::kSrc || coverage)
+        {
+            p->append(stage_load_dst);
+            p->append(gPipelineBlendStages[(int)mode]);
+        }
+        if (coverage)
+        {
+            p->append(stage_lerp_coverage);
+        }
+        p->append(stage_store);
+    }
+
     virtual void drawPath(const GPath &path, const GPaint &paint) override
     {
-        if (path.countPoints() < 3)
+        if (path.countPoints() < 3 || quickReject(path.bounds()))
+        {
+            return;
+        }
+        Blitter blitter = makeBlitter(paint);
+        if (blitter.isNop())
+        {
+            return;
+        }
+
+        // a single rect contour (addRect(), say) that is still a rect on the device
+        GPoint quad[4];
+        GRect rect;
+        if (path_is_quad(path, quad))
+        {
+            stack.back().mapPoints(quad, quad, 4);
+            if (points_are_rect(quad, 4, &rect) && drawDeviceRect(rect, paint, blitter))
+            {
+                return;
+            }
+        }
+
+        ScratchArena::AutoReset reset(&fScratch);
+        if (paint.isAntiAlias())
+        {
+            ScratchArray<AAEdge> edges(&fScratch);
+            path_edges(path, fAAEdgeCache, edges);
+            aa_scan(edges, blitter);
+            return;
+        }
+        ScratchArray<Edge> edges(&fScratch);
+        path_edges(path, fEdgeCache, edges);
+        // scan -> blit (complex_scan buckets the edges by y itself, no global sort)
+        complex_scan(edges, blitter);
+    }
+
+    CacheStats edgeCacheStats() const override
+    {
+        CacheStats stats;
+        stats.fHits = fEdgeCache.hits() + fAAEdgeCache.hits();
+        stats.fMisses = fEdgeCache.misses() + fAAEdgeCache.misses();
+        stats.fBytes = fEdgeCache.bytes() + fAAEdgeCache.bytes();
+        stats.fBudget = fEdgeCache.budget() + fAAEdgeCache.budget();
+        return stats;
+    }
+
+    // the path's device edges under the CTM: from the edge cache if it has them, otherwise
+    // built (see EdgeCache for the two ways) and added to it
+    template <typename E>
+    void path_edges(const GPath &path, EdgeCache<E> &cache, ScratchArray<E> &edges)
+    {
+        const GMatrix &ctm = stack.back();
+        GMatrix matrix;
+        int dx = 0, dy = 0;
+        bool split = split_translate(ctm, &matrix, &dx, &dy);
+        uint32_t id = path.getGenerationID();
+        if (cache.find(id, ctm, split, matrix, dx, dy, fDevice.width(), fDevice.height(), edges))
         {
             return;
         }
 
-        // create a copy of the path to use so this worrks
-        GPath pathcpy = path;
-        pathcpy.transform(stack.back());
+        typename EdgeCache<E>::Key key;
+        key.fGenID = id;
+        key.fWidth = fDevice.width();
+        key.fHeight = fDevice.height();
+        key.fMatrix = matrix;
+        if (split && build_movable_edges(path, dx, dy, &key, edges))
+        {
+            key.fMovable = true;
+            cache.add(key, edges.data(), edges.size());
+            for (E &e : edges)
+            {
+                offset_edge(e, dx - key.fOriginX, dy - key.fOriginY);
+            }
+            return;
+        }
+        edges.clear();
+        build_path_edges(path, ctm, edges);
+        key.fMatrix = ctm;
+        key.fMovable = false;
+        cache.add(key, edges.data(), edges.size());
+    }
+
+    /**
+     *  Builds the path's edges under key->fMatrix (a CTM minus its whole-pixel translate),
+     *  unclipped, at a whole-pixel origin that only depends on that matrix: the bounds'
+     *  top-left lands at (1, 1) or just past it, so the edges look like device edges. Fills in
+     *  the key's origin and bounds.
+     *
+     *  Returns false if moving the edges by the rest of the translate, (dx, dy), doesn't put
+     *  them all inside the device (so they need clipping instead).
+     */
+    template <typename E>
+    bool build_movable_edges(const GPath &path, int dx, int dy, typename EdgeCache<E>::Key *key,
+                             ScratchArray<E> &edges)
+    {
+        const int w = fDevice.width(), h = fDevice.height();
+        // curves stay inside their control points, so those bound the whole path
+        GRect bounds = key->fMatrix.mapRect(path.bounds());
+        float ox = 1 - std::floor(bounds.fLeft), oy = 1 - std::floor(bounds.fTop);
+        // written so nan fails too
+        if (!(std::abs(ox) < w + 2.0f && std::abs(oy) < h + 2.0f))
+        {
+            return false;
+        }
+        key->fOriginX = (int)ox;
+        key->fOriginY = (int)oy;
+        key->fBounds = GRect::LTRB(bounds.fLeft + ox, bounds.fTop + oy, bounds.fRight + ox, bounds.fBottom + oy);
+        dx -= key->fOriginX;
+        dy -= key->fOriginY;
+        if (!fits_device(key->fBounds, dx, dy, w, h))
+        {
+            return false;
+        }
+
+        GMatrix m = key->fMatrix;
+        m[GMatrix::TX] += ox;
+        m[GMatrix::TY] += oy;
+        // the bounds say every point fits; check each one anyway, as the bounds skip nans
+        // (and map the corners, not the points, so may round differently)
+        auto fits = [&](const GPoint pts[], int count)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                if (!fits_device(GRect::LTRB(pts[i].fX, pts[i].fY, pts[i].fX, pts[i].fY), dx, dy, w, h))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        // nothing to clip: straight to edges
+        auto line = [&](GPoint p0, GPoint p1)
+        {
+            E e;
+            if (e.init(p0, p1))
+            {
+                edges.push_back(e);
+            }
+        };
+        return walk_path(path, m, fits, line);
+    }
+
+    // all of the path's edges under ctm, clipped to the device
+    template <typename E>
+    void build_path_edges(const GPath &path, const GMatrix &ctm, ScratchArray<E> &edges)
+    {
+        auto any = [](const GPoint[], int)
+        { return true; };
+        auto line = [&](GPoint p0, GPoint p1)
+        { clip(p0, p1, edges, fDevice); };
+        walk_path(path, ctm, any, line);
+    }
+
+    /**
+     *  Walks the path, mapping it to device space as it goes (so the path itself is never
+     *  copied or transformed), and flattens curves into lines. Each segment's points go to
+     *  check(pts, count) first, and the walk stops (returning false) if that returns false;
+     *  then every line goes to line(p0, p1).
+     */
+    template <typename CheckProc, typename LineProc>
+    static bool walk_path(const GPath &path, const GMatrix &ctm, CheckProc check, LineProc line)
+    {
         // edger makes our edges <3
-        GPath::Edger edger(pathcpy);
+        GPath::Edger edger(path, ctm);
         GPath::Verb v;
         GPoint pts[4];
-        std::vector<Edge> edges = {};
-        // clipping each edge from the edger
         while ((v = edger.next(pts)) != GPath::kDone)
         {
             // must check for quad, cubic, or line in here
             // in case there is a path with multiple types
+            if (!check(pts, v == GPath::kLine ? 2 : (v == GPath::kQuad ? 3 : 4)))
+            {
+                return false;
+            }
             if (v == GPath::kLine)
             {
-                // ctm -> mapints(points, points, 2)]]
-                clip(pts[0], pts[1], edges, fDevice);
-                if (edges.size() > 0)
-                {
-                    assert(edges.back().fY >= 0);
-                }
+                line(pts[0], pts[1]);
             }
             else
             {
-                // getting the amount of segments and where they will lay in (0, 1) coordinates
-                int segmentCount = segCount(v, pts);
-                // int segmentCount = 3;
-                // printf("seg count: \n");
-                // std::cout << segmentCount << std::endl;
-                float step = 1.0f / segmentCount;
-                GPoint P1, P2;
-                GPoint (*evalfn)(const GPoint *pts, float t);
+                // exact segment count from the 1/4 pixel tolerance (a flat curve gives 0,
+                // but it still needs one line to keep the contour closed)
+                int segmentCount = std::max(segCount(v, pts), 1);
                 if (v == GPath::kQuad)
                 {
-                    evalfn = &eval_quad;
+                    flatten_quad(pts, segmentCount, line);
                 }
                 else
                 {
-                    evalfn = &eval_cubic;
+                    flatten_cubic(pts, segmentCount, line);
                 }
-                // for (float t = 0.0f; t < 1.0f; t += step)
-                // stick to the beginning and end here
-                // P1 = pts[0];
-                // P2 = evalfn(pts, 0.0f);
-                // at the end, p2 = pts[1]
-                // for (int i = 0; i < segmentCount; i++)
-                // if (v == GPath::kCubic) {
-                //     Gpoint a = map
-                // }
-                GPoint save = P1;
-                
-                for (float t = 0.0f; t < 1.0f; t += step)
+            }
+        }
+        return true;
+    }
+
+    /**
+     *  Active-edge-table scan converter (non-zero winding).
+     *
+     *  Edges are bucketed by their starting scanline, so there is no global sort. Each row,
+     *  the edges starting there join the tail of the active list (in x order), the list is
+     *  walked once for winding, then dead edges are swap-removed and the survivors stepped
+     *  and put back in x order with an insertion sort (the list is nearly sorted from one
+     *  row to the next, so that's close to linear).
+     *
+     *  Rows above fTop are never walked: edges that start above it are stepped straight down
+     *  to fTop, so a band canvas only sorts and winds its own rows.
+     */
+    void complex_scan(ScratchArray<Edge> &edges, const Blitter &blitter)
+    {
+        int h = fDevice.height();
+
+        // counting sort into per-row buckets: bucket y is [starts[y], starts[y + 1]). edges
+        // still alive at fTop that start above it are carried in instead
+        ScratchArray<int> starts(&fScratch, h + 1, 0);
+        ScratchArray<Edge> carried(&fScratch);
+        for (const Edge &e : edges)
+        {
+            assert(e.fY >= 0);
+            if (e.fY < fTop)
+            {
+                // the edge's row fTop - 1 is where it would have been retired
+                if (e.fLastY >= fTop - 1)
                 {
-                    // WE MUST MAKE THE LINES TOUCH
-                    // the previous p2 is the new p1
-                    // here is where we maintain topological contract 
-
-                    P1 = P2;
-                    P2 = evalfn(pts, t);
-                    if (t == 0.0f)
-                    {
-                        clip(pts[0], P2, edges, fDevice);
-                    }
-                    else
-                    {
-                        clip(P1, P2, edges, fDevice);
-                    }
-                    if (edges.size() > 0)
-                    {
-                        assert(edges.back().fY >= 0);
-                    }
+                    Edge c = e;
+                    // the same 32-bit sum stepping it row by row would give
+                    c.fX = (Fixed16)((uint32_t)c.fX + (uint32_t)c.fDX * (uint32_t)(fTop - c.fY));
+                    c.fY = fTop;
+                    carried.push_back(c);
                 }
-                if (v == GPath::kQuad)
+            }
+            else if (e.fY < h)
+            {
+                starts[e.fY + 1]++;
+            }
+        }
+        for (int y = 0; y < h; y++)
+        {
+            starts[y + 1] += starts[y];
+        }
+        int remaining = starts[h];
+        if (remaining == 0 && carried.empty())
+        {
+            return;
+        }
+        ScratchArray<Edge> buckets(&fScratch, remaining, Edge());
+        ScratchArray<int> cursor(&fScratch, h);
+        cursor.append(starts.begin(), starts.end() - 1);
+        for (const Edge &e : edges)
+        {
+            if (e.fY >= fTop && e.fY < h)
+            {
+                buckets[cursor[e.fY]++] = e;
+            }
+        }
+
+        // carried edges go first, sorted, as if they had been stepped down to fTop
+        ActiveEdgeList active(&fScratch, remaining + (int)carried.size());
+        int y = fTop;
+        if (!carried.empty())
+        {
+            std::sort(carried.begin(), carried.end(), sortByX);
+            for (const Edge &e : carried)
+            {
+                active.add(e);
+            }
+        }
+        else
+        {
+            while (starts[y + 1] == starts[y])
+            {
+                y++;
+            }
+        }
+        for (; y < fBottom && (remaining > 0 || !active.empty()); y++)
+        {
+            // new edges join at the tail, in x order
+            auto first = buckets.begin() + starts[y];
+            auto last = buckets.begin() + starts[y + 1];
+            if (first != last)
+            {
+                std::sort(first, last, sortByX);
+                for (auto e = first; e != last; ++e)
                 {
-                    clip(P2, pts[2], edges, fDevice);
+                    active.add(*e);
                 }
-                else
+                remaining -= (int)(last - first);
+            }
+
+            int w = 0; // wind tracker
+            int L = 0;
+            for (int i = 0; i < active.count(); i++)
+            {
+                if (w == 0)
+                {
+                    L = i;
+                }
+                w += active.wind(i);
+                if (w == 0)
                 {
-                    clip(P2, pts[3], edges, fDevice);
+                    blit(std::min(active.x(L), active.x(i)), std::max(active.x(L), active.x(i)), y, blitter);
                 }
-                // clip(P2, pts[2], edges, fDevice);
             }
+
+            // retire edges that are done, step the rest (all at once), and re-sort
+            active.retireAndStep(y);
+            active.sortByX();
         }
-        // clip(pts[0], pts[1], edges, fDevice);
+    }
 
-        // sort (y, x, m)
-        if (edges.size() == 0)
+    // anti-aliased scan conversion: exact area coverage from sparse cells (see aa_scan.h)
+    void aa_scan(ScratchArray<AAEdge> &edges, const Blitter &blitter)
+    {
+        int w = fDevice.width();
+        ScratchArray<CoverageCell> cells(&fScratch);
+        for (const AAEdge &e : edges)
+        {
+            accumulate_edge(e, cells, w);
+        }
+        // rows outside the canvas's own never get blitted, so don't sort them
+        auto end = std::remove_if(cells.begin(), cells.end(), [this](const CoverageCell &c)
+                                  { return c.fY < fTop || c.fY >= fBottom; });
+        while (cells.end() != end)
+        {
+            cells.pop_back();
+        }
+        if (cells.empty())
         {
             return;
         }
-        // sort by y
-        std::sort(edges.begin(), edges.end(), pred);
-        assert(edges[0].fY >= 0);
-        // scan -> blit
-        complex_scan(edges, edges.size(), paint);
+        std::sort(cells.begin(), cells.end(), cell_order);
+
+        ScratchArray<uint8_t> coverage(&fScratch, w, 0);
+        sweep_cells(cells, w, coverage.data(), [&](int y, int left, int right, const uint8_t cov[])
+                    { blit_coverage(y, left, right, cov, blitter); });
     }
 
-    void complex_scan(std::vector<Edge> &edges, int count, const GPaint &paint)
+    // blits [left, right) of row y, where coverage[x] is how much of pixel x is covered
+    void blit_coverage(int y, int left, int right, const uint8_t coverage[], const Blitter &blitter)
     {
-        if (count <= 0)
+        if (left >= right || y < fTop || y >= fBottom)
         {
             return;
         }
-
-        assert(edges[0].fY >= 0);
-        for (int y = edges[0].fY; count > 0 && y < fDevice.height(); y++)
+        GPixel *dst = fDevice.getAddr(0, y);
+        if (blitter.shader != nullptr)
         {
-            int i = 0; // index
-            int w = 0; // wind tracker
-            Edge L, R; // left and right edge
-            // assert(false);
+            // the pipeline lerps by coverage itself
+            blitter.shadeSpan(left, y, right - left, dst + left, coverage + left);
+            return;
+        }
 
-            // loop through active edges
-            while ((i < count) && (edges[i].fY <= y))
+        // full runs use the normal row procs, partial ones lerp by coverage
+        int x = left;
+        while (x < right)
+        {
+            int start = x;
+            uint8_t a = coverage[x];
+            if (a == 0)
             {
-                assert(edges[i].fY >= 0);
-                // resort = false;
-                if (i >= edges.size())
-                {
-                    return;
-                }
-                if (w == 0)
+                while (x < right && coverage[x] == 0)
                 {
-                    L = edges[i];
+                    x++;
                 }
-                w += edges[i].fWind;
-                if (w == 0)
-                {
-                    R = edges[i];
-                    if (R.fCurrX < L.fCurrX) {
-                        Edge tmp = L;
-                        L = R;
-                        R = tmp;
-                    }
-                    blit(L, R, y, paint);
-                }
-                if ((y - 1) >= edges[i].fLastY)
+            }
+            else if (a == 255)
+            {
+                while (x < right && coverage[x] == 255)
                 {
-                    edges.erase(edges.begin() + i);
-                    count--;
+                    x++;
                 }
-                else
+                blitter.colorSpan(start, y, x - start, dst + start);
+            }
+            else
+            {
+                while (x < right && coverage[x] != 0 && coverage[x] != 255)
                 {
-                    edges[i].fCurrX += edges[i].fSlope;
-                    i++;
+                    x++;
                 }
-                std::sort(edges.begin(), edges.begin() + i, sortByX);
+                blitter.colorSpan(start, y, x - start, dst + start, coverage + start);
             }
-            // assert(w == 0);
         }
     }
 
-    void blit(Edge &L, Edge &R, int y, GPaint paint)
+    // fills row y between two edges: the span is clamped to the device once, then handed to
+    // the row procs as one contiguous run
+    void blit(Fixed16 L, Fixed16 R, int y, const Blitter &blitter)
     {
-        // settin' up
-        int Lx = GRoundToInt(L.fCurrX);
-        int Rx = GRoundToInt(R.fCurrX);
-
-        GColor color = paint.getColor();
-        GPixel src = colorToPixel(color);
-        GBlendMode blmd = paint.getBlendMode();
-
-        // if there is a shader
-        if (paint.getShader() != nullptr)
+        if (y < fTop || y >= fBottom)
         {
-            // if the currrent matrix is valid
-            if (paint.getShader()->setContext(stack.back()))
-            {
-                // creating row and shading said row
-                GPixel row[Rx - Lx];
-                paint.getShader()->shadeRow(Lx, y, Rx - Lx, row);
+            return;
+        }
+        int left = std::max(fixed16_round(L), 0);
+        int right = std::min(fixed16_round(R), fDevice.width());
+        if (left >= right)
+        {
+            return;
+        }
+        GPixel *dst = fDevice.getAddr(left, y);
+        if (blitter.shader == nullptr)
+        {
+            blitter.colorSpan(left, y, right - left, dst);
+            return;
+        }
+        // shade just the visible span
+        blitter.shadeSpan(left, y, right - left, dst);
+    }
 
-                // doing the real coloring
-                for (int x = Lx; x < Rx && x >= 0 && x < fDevice.width(); x++)
-                {
-                    GPixel *dst = fDevice.getAddr(x, y);
-                    // if opaque, assign to pixel in row ("src"). else, blend
-                    if (paint.getShader()->isOpaque())
-                    {
-                        *dst = row[x - Lx];
-                    }
-                    else
-                    {
-                        *dst = blendme(blmd, *dst, row[x - Lx]);
-                    }
-                }
-            }
-            // we're done
+    // the rect engine: fills the pixels of a device rect (already rounded to pixels) a row at
+    // a time, with no edges. big solid fills stream straight to memory
+    void blitRect(const GIRect &r, const Blitter &blitter)
+    {
+        int left = std::max(r.left(), 0);
+        int right = std::min(r.right(), fDevice.width());
+        int top = std::max(r.top(), fTop);
+        int bottom = std::min(r.bottom(), fBottom);
+        if (left >= right || top >= bottom)
+        {
             return;
         }
-        else
+        int width = right - left;
+        if (blitter.shader != nullptr)
         {
-            // elif there's not a shader, simple blit
-            for (int x = Lx; x < Rx && x >= 0 && x < fDevice.width(); x++)
+            for (int y = top; y < bottom; y++)
             {
-                GPixel *p = fDevice.getAddr(x, y);
-                if (blmd == GBlendMode::kSrcOver)
-                {
-                    int sa = GPixel_GetA(src);
-                    int sr = GPixel_GetR(src);
-                    int sg = GPixel_GetG(src);
-                    int sb = GPixel_GetB(src);
-                    int da = GPixel_GetA(*p);
-                    int dr = GPixel_GetR(*p);
-                    int dg = GPixel_GetG(*p);
-                    int db = GPixel_GetB(*p);
-                    int norm = 255 - sa;
-
-                    unsigned a = sa + div255(norm * da);
-                    unsigned r = sr + div255(norm * dr);
-                    unsigned g = sg + div255(norm * dg);
-                    unsigned b = sb + div255(norm * db);
-                    *p = GPixel_PackARGB(a, r, g, b);
-                }
-                else
-                {
-                    *p = blendme(blmd, *p, src);
-                }
+                blitter.shadeSpan(left, y, width, fDevice.getAddr(left, y));
             }
+            return;
+        }
+        if ((size_t)width * (bottom - top) * sizeof(GPixel) >= kStreamFillBytes && !blitter.lowpColorRows &&
+            (blitter.colorProc == fill_color_row || blitter.colorProc == clear_color_row))
+        {
+            GPixel color = blitter.colorProc == clear_color_row ? 0 : blitter.src;
+            stream_fill_rect(fDevice.getAddr(left, top), fDevice.rowBytes(), width, bottom - top, color);
+            return;
+        }
+        for (int y = top; y < bottom; y++)
+        {
+            blitter.colorSpan(left, y, width, fDevice.getAddr(left, y));
+        }
+    }
+
+    // a rect in device space (a mapped drawRect, or a polygon or path that turned out to be
+    // one) through the rect engine. false if anti-aliasing would give it partial pixels, which
+    // the rect engine doesn't do
+    bool drawDeviceRect(const GRect &rect, const GPaint &paint, const Blitter &blitter)
+    {
+        if (paint.isAntiAlias() && !is_pixel_aligned(rect))
+        {
+            return false;
         }
+        // aliased, a pixel is in if its center is: that's the rect rounded. pinned to the device
+        // first, so huge rects still round to ints (and, never negative, round by truncating)
+        auto round = [](float v, float max) { return (int)(std::max(std::min(v, max), 0.0f) + 0.5f); };
+        const float w = fDevice.width(), h = fDevice.height();
+        this->blitRect(GIRect::LTRB(round(rect.fLeft, w), round(rect.fTop, h), round(rect.fRight, w), round(rect.fBottom, h)),
+                       blitter);
+        return true;
+    }
+
+    virtual bool quickReject(const GRect &bounds) const override
+    {
+        const GMatrix &ctm = stack.back();
+        return rejectDeviceRect(is_scale_translate(ctm) ? map_scale_translate(ctm, bounds) : ctm.mapRect(bounds));
+    }
+
+    // true if nothing inside dev (device space) can touch our pixels, so a draw can stop before
+    // it sets up a blitter or builds a single edge. maps and scrolled lists are mostly draws
+    // like that
+    bool rejectDeviceRect(const GRect &dev) const
+    {
+        // a pixel of slop on every side: rounding and AA coverage reach a little past the bounds
+        return dev.fRight < -1 || dev.fBottom < fTop - 1 || dev.fLeft > fDevice.width() + 1 ||
+               dev.fTop > fBottom + 1;
     }
 
     virtual void save() override
@@ -284,98 +766,157 @@ public:
 
     void drawPaint(const GPaint &paint) override
     {
-        GBlendMode blmd = paint.getBlendMode();
-        GColor color = paint.getColor();
-        GPixel src = colorToPixel(color);
-        // height and width of bitmap
-        int h = fDevice.height();
-        int w = fDevice.width();
+        Blitter blitter = makeBlitter(paint);
+        if (blitter.isNop())
+        {
+            return;
+        }
+        // the whole bitmap (a band canvas only covers rows [fTop, fBottom))
+        blitRect(GIRect::LTRB(0, fTop, fDevice.width(), fBottom), blitter);
+    }
 
-        // set the CTM for the shader if there is one
-        if (paint.getShader() != nullptr)
+    void drawRect(const GRect &rect, const GPaint &paint) override
+    {
+        const GMatrix &ctm = stack.back();
+        if (is_scale_translate(ctm))
         {
-            if (paint.getShader()->setContext(stack.back()))
+            GRect dev = map_scale_translate(ctm, rect);
+            if (rejectDeviceRect(dev))
             {
-                for (int y = 0; y < h; y++)
-                {
-                    GPixel row[w];
-                    paint.getShader()->shadeRow(0, y, w, row);
-                    for (int x = 0; x < w; x++)
-                    {
-                        GPixel *dst = fDevice.getAddr(x, y);
-                        *dst = blendme(blmd, *dst, row[x]);
-                    }
-                }
+                return;
             }
-            // we're done
+            // the src alpha picks the row proc (and lets us skip no-op draws)
+            Blitter blitter = makeBlitter(paint);
+            if (blitter.isNop())
+            {
+                return;
+            }
+            // still a rect on the device: straight to the rect engine, shaded or not
+            if (drawDeviceRect(dev, paint, blitter))
+            {
+                return;
+            }
+        }
+
+        // if the CTM rotates or skews the rect (or it's anti-aliased with partial pixels),
+        // let's please convert to a 4-sided polygon
+        GPoint pts[] = {{rect.fLeft, rect.fTop}, {rect.fLeft, rect.fBottom},
+                        {rect.fRight, rect.fBottom}, {rect.fRight, rect.fTop}};
+        drawConvexPolygon(pts, 4, paint);
+    }
+
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint &paint) override
+    {
+        if (count < 3)
+        {
             return;
         }
-        for (int y = 0; y < h; y++)
+
+        // translate the points to the ones we need thru the CTM (returns same if no mx)
+        ScratchArena::AutoReset reset(&fScratch);
+        GPoint *mapped_pts = fScratch.make<GPoint>(count);
+        stack.back().mapPoints(mapped_pts, pts, count);
+        if (rejectDeviceRect(bounds_of(mapped_pts, count)))
         {
-            for (int x = 0; x < w; x++)
-            {
-                GPixel *p = fDevice.getAddr(x, y);
-                *p = blendme(blmd, *p, src);
-            };
-        };
+            return;
+        }
+        Blitter blitter = makeBlitter(paint);
+        if (blitter.isNop())
+        {
+            return;
+        }
+        fillDevicePolygon(mapped_pts, count, paint, blitter);
     }
 
-    void drawRect(const GRect &rect, const GPaint &paint) override
+    void drawRects(const GRect rects[], const GColor colors[], int count, const GPaint &paint) override
     {
-        // checks and stores params of rectangle, comparing against boundaries of bm
-        GIRect rr = rect.round();
-        int L = rr.left();
-        int R = rr.right();
-        int T = rr.top();
-        int B = rr.bottom();
-
-        // if rect has a shader, let's please convert to a 4-sided polygon
-        if (paint.getShader() != nullptr)
-        {
-            GPoint P0 = {L, T};
-            GPoint P1 = {L, B};
-            GPoint P2 = {R, B};
-            GPoint P3 = {R, T};
-            GPoint pts[] = {P0, P1, P2, P3};
-            drawConvexPolygon(pts, 4, paint);
+        const GMatrix &ctm = stack.back();
+        if (!is_scale_translate(ctm))
+        {
+            GCanvas::drawRects(rects, colors, count, paint);
             return;
-        };
-
-        int DW = fDevice.width();
-        int DH = fDevice.height();
+        }
+        BatchBlitters blitters(this, paint);
+        for (int i = 0; i < count; i++)
+        {
+            GRect dev = map_scale_translate(ctm, rects[i]);
+            if (rejectDeviceRect(dev))
+            {
+                continue;
+            }
+            const Blitter &blitter = blitters.forColor(colors[i]);
+            if (!blitter.isNop() && !drawDeviceRect(dev, paint, blitter))
+            {
+                // anti-aliased, with partial pixels
+                drawRect(rects[i], GPaint(paint).setColor(colors[i]).setShader(nullptr));
+            }
+        }
+    }
 
-        int left = L >= 0 ? L : 0;
-        int right = R <= DW ? R : DW;
-        int top = T >= 0 ? T : 0;
-        int bottom = B <= DH ? B : DH;
+    void drawConvexPolygons(const GPoint pts[], const int counts[], const GColor colors[], int count,
+                            const GPaint &paint) override
+    {
+        int total = 0;
+        for (int i = 0; i < count; i++)
+        {
+            total += counts[i];
+        }
+        // every point of the batch mapped in one go, into scratch that lasts the whole batch.
+        // each polygon's own scratch (edges, coverage) is handed back once it's drawn, so the
+        // arena only ever holds one polygon's worth on top of the points
+        ScratchArena::AutoReset reset(&fScratch);
+        GPoint *mapped = fScratch.make<GPoint>(total);
+        stack.back().mapPoints(mapped, pts, total);
+        const ScratchArena::Mark mark = fScratch.mark();
 
-        // check source's alpha first
-        GColor color = paint.getColor();
-        GPixel src = colorToPixel(color);
-        GBlendMode blmd = paint.getBlendMode();
-        for (int y = top; y < bottom; y++)
+        BatchBlitters blitters(this, paint);
+        for (int i = 0; i < count; mapped += counts[i], i++)
         {
-            for (int x = left; x < right; x++)
+            if (counts[i] < 3 || rejectDeviceRect(bounds_of(mapped, counts[i])))
+            {
+                continue;
+            }
+            const Blitter &blitter = blitters.forColor(colors[i]);
+            if (!blitter.isNop())
             {
-                GPixel *p = fDevice.getAddr(x, y);
-                *p = blendme(blmd, *p, src);
+                fillDevicePolygon(mapped, counts[i], paint, blitter);
+                fScratch.rewind(mark);
             }
         }
     }
 
-    void drawConvexPolygon(const GPoint pts[], int count, const GPaint &paint) override
+    // drawConvexPolygon() once the points are in device space. edges (if it needs any) come
+    // from fScratch, so the caller resets it
+    void fillDevicePolygon(const GPoint mapped_pts[], int count, const GPaint &paint, const Blitter &blitter)
     {
-        if (count < 3)
+        // still an axis-aligned rect on the device: no edges needed
+        GRect rect;
+        if (points_are_rect(mapped_pts, count, &rect) && drawDeviceRect(rect, paint, blitter))
         {
             return;
         }
 
-        // translate the points to the ones we need thru the CTM (returns same if no mx)
-        GPoint mapped_pts[count];
-        stack.back().mapPoints(mapped_pts, pts, count);
+        if (paint.isAntiAlias())
+        {
+            ScratchArray<AAEdge> edges(&fScratch, count);
+            for (int i = 0; i < count; i++)
+            {
+                clip(mapped_pts[i], mapped_pts[(i + 1) % count], edges, fDevice);
+            }
+            aa_scan(edges, blitter);
+            return;
+        }
+
+        // walk the left and right sides straight from the points: no edges, no sort
+        if (walk_convex(mapped_pts, count, fTop, fBottom, [&](int y, Fixed16 x0, Fixed16 x1)
+                        { blit(x0, x1, y, blitter); }))
+        {
+            return;
+        }
 
-        // build edges (the order of the points are the order of the connections)
-        std::vector<Edge> edges = {};
+        // the walker couldn't take it (huge coordinates, or not really convex), so clip and
+        // sort edges instead. build edges (the order of the points are the order of the connections)
+        ScratchArray<Edge> edges(&fScratch, count);
 
         // for each point in pts array, create edge between and push to vec
         for (int i = 0; i < count - 1; i++)
@@ -413,14 +954,8 @@ public:
         Edge L = edges[i];
         Edge R = edges[j];
 
-        // set the CTM for the shader if there is one
-        if (paint.getShader() != nullptr)
-        {
-            paint.getShader()->setContext(stack.back());
-        }
-
         // loop y, set L and R
-        for (int y = top; (y <= bottom) && (y >= 0) && (y < fDevice.height()); y++)
+        for (int y = top; (y <= bottom) && (y >= 0) && (y < fBottom); y++)
         {
             if (GRoundToInt(y - 1) >= edges[i].fLastY)
             {
@@ -439,10 +974,10 @@ public:
             }
 
             // call the fn that traverses the x on the row we're on
-            blit(L, R, y, paint);
+            blit(L.fX, R.fX, y, blitter);
             // update x vals
-            L.fCurrX = L.fSlope + L.fCurrX;
-            R.fCurrX = R.fSlope + R.fCurrX;
+            L.fX += L.fDX;
+            R.fX += R.fDX;
         }
     }
     
@@ -454,29 +989,48 @@ public:
         {
             return e1.fY < e2.fY;
         }
-        if (e1.fCurrX != e2.fCurrX)
+        if (e1.fX != e2.fX)
         {
-            return e1.fCurrX < e2.fCurrX;
+            return e1.fX < e2.fX;
         }
-        return e1.fSlope < e2.fSlope;
+        return e1.fDX < e2.fDX;
     }
 
     static bool sortByX(Edge const &e1, Edge const &e2)
     {
-        if (e1.fCurrX != e2.fCurrX)
+        if (e1.fX != e2.fX)
         {
-            return e1.fCurrX < e2.fCurrX;
+            return e1.fX < e2.fX;
         }
-        return e1.fSlope < e2.fSlope;
+        return e1.fDX < e2.fDX;
     }
 
 private:
     // Note: we store a copy of the bitmap
     const GBitmap fDevice;
+    const int fTop;
+    const int fBottom;
     std::vector<GMatrix> stack;
+    // every draw's edges, coverage and mapped points (reset when the draw returns)
+    ScratchArena fScratch;
+    // edges of recently drawn paths, aliased and anti-aliased
+    EdgeCache<Edge> fEdgeCache{kEdgeCacheBudget};
+    EdgeCache<AAEdge> fAAEdgeCache{kEdgeCacheBudget};
 };
 
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap &device)
 {
     return std::unique_ptr<GCanvas>(new MyCanvas(device));
 }
+
+// used by the tiled canvas (tiled_canvas.cpp): a canvas that only draws rows [top, bottom)
+std::unique_ptr<GCanvas> GCreateBandCanvas(const GBitmap &device, int top, int bottom)
+{
+    return std::unique_ptr<GCanvas>(new MyCanvas(device, top, bottom));
+}
+
+// used by the tests (tests_canvas.cpp): the scratch a canvas from GCreateCanvas holds on to
+size_t GCanvasScratchBytes(const GCanvas *canvas)
+{
+    return static_cast<const MyCanvas *>(canvas)->scratchBytes();
+}
@@ -0,0 +1,390 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef raster_pipeline_DEFINED
+#define raster_pipeline_DEFINED
+
+#include "GBlendMode.h"
+#include "GColor.h"
+#include "GMatrix.h"
+#include "GPixel.h"
+#include "GShader.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+// the same test span_blit.h makes for SPAN_BLIT_SSE2
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define RASTER_PIPELINE_SSE2 1
+#endif
+
+/**
+ *  A float raster pipeline: a draw is compiled (once) into a short list of stages, e.g.
+ *
+ *      seed coords -> [shader's stages] -> scale by paint alpha -> load dst -> blend -> store
+ *
+ *  and run() pushes each span through the whole list kPipelineLanes pixels at a time. The
+ *  pixels stay in float registers from the shader to the store: nothing is packed to 8 bits
+ *  and reloaded in between, and nothing is rounded until the very end.
+ *
+ *  Every stage works on all the lanes with a fixed trip count, so the compiler can keep them
+ *  in vector registers. Lanes past the end of a short span (n < kPipelineLanes) are computed
+ *  anyway but never loaded from or stored to dst.
+ */
+enum
+{
+    kPipelineLanes = 8
+};
+
+struct PipelineLanes
+{
+    float r[kPipelineLanes], g[kPipelineLanes], b[kPipelineLanes], a[kPipelineLanes];     // src
+    float dr[kPipelineLanes], dg[kPipelineLanes], db[kPipelineLanes], da[kPipelineLanes]; // dst
+    float x[kPipelineLanes], y[kPipelineLanes]; // sample coordinates
+
+    int dx, dy;               // device coordinates of lane 0
+    int n;                    // live lanes
+    GPixel *dst;              // dst pixel of lane 0
+    const uint8_t *coverage;  // coverage of lane 0, or nullptr if the span is fully covered
+};
+
+typedef void (*PipelineStageFn)(PipelineLanes &p, const void *ctx);
+
+class RasterPipeline
+{
+public:
+    // ctx must stay alive (and unchanged) for as long as the pipeline is run
+    void append(PipelineStageFn fn, const void *ctx = nullptr)
+    {
+        assert(fCount < kMaxStages);
+        fStages[fCount].fFn = fn;
+        fStages[fCount].fCtx = ctx;
+        fCount++;
+    }
+
+    // runs pixels [x, x + count) of row y, whose dst is dst[0 ... count - 1]. coverage (if not
+    // null) is count values, lined up with dst
+    void run(int x, int y, int count, GPixel dst[], const uint8_t coverage[]) const
+    {
+        PipelineLanes p;
+        p.dy = y;
+        for (int start = 0; start < count; start += kPipelineLanes)
+        {
+            p.dx = x + start;
+            p.n = std::min(count - start, (int)kPipelineLanes);
+            p.dst = dst + start;
+            p.coverage = coverage != nullptr ? coverage + start : nullptr;
+            for (int i = 0; i < fCount; i++)
+            {
+                fStages[i].fFn(p, fStages[i].fCtx);
+            }
+        }
+    }
+
+private:
+    enum
+    {
+        kMaxStages = 16
+    };
+    struct Stage
+    {
+        PipelineStageFn fFn;
+        const void *fCtx;
+    };
+    Stage fStages[kMaxStages];
+    int fCount = 0;
+};
+
+/**
+ *  floorf() is a call into libm on baseline x86-64 (there's no rounding instruction before
+ *  SSE4.1), which would keep every stage that floors out of vector registers. Truncating and
+ *  then fixing up negative fractions is a convert and a compare instead. v is pinned first,
+ *  so the conversion can't overflow.
+ */
+static inline int pipeline_floor_int(float v)
+{
+    const float kLimit = 1 << 30;
+    v = std::min(std::max(v, -kLimit), kLimit);
+    int t = (int)v;
+    return t - (v < t ? 1 : 0);
+}
+
+static inline float pipeline_floor(float v)
+{
+    return (float)pipeline_floor_int(v);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// coordinates
+
+// x, y = the device pixel centers
+static inline void stage_seed_device_coords(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.x[i] = p.dx + i + 0.5f;
+        p.y[i] = p.dy + 0.5f;
+    }
+}
+
+// x, y = ctx (a GMatrix) * (x, y)
+static inline void stage_matrix(PipelineLanes &p, const void *ctx)
+{
+    const GMatrix &m = *static_cast<const GMatrix *>(ctx);
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        float x = p.x[i];
+        float y = p.y[i];
+        p.x[i] = m[GMatrix::SX] * x + m[GMatrix::KX] * y + m[GMatrix::TX];
+        p.y[i] = m[GMatrix::KY] * x + m[GMatrix::SY] * y + m[GMatrix::TY];
+    }
+}
+
+// x = |(x, y)|
+static inline void stage_xy_to_radius(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.x[i] = p.x[i] * p.x[i] + p.y[i] * p.y[i];
+    }
+    // std::sqrt may set errno, which keeps the compiler from vectorizing it
+#ifdef RASTER_PIPELINE_SSE2
+    for (int i = 0; i < kPipelineLanes; i += 4)
+    {
+        _mm_storeu_ps(p.x + i, _mm_sqrt_ps(_mm_loadu_ps(p.x + i)));
+    }
+#else
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.x[i] = std::sqrt(p.x[i]);
+    }
+#endif
+}
+
+// tile x into [0, 1]
+static inline void stage_clamp_x(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.x[i] = std::min(std::max(p.x[i], 0.0f), 1.0f);
+    }
+}
+
+static inline void stage_repeat_x(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.x[i] = p.x[i] - pipeline_floor(p.x[i]);
+    }
+}
+
+static inline void stage_mirror_x(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        float t = p.x[i] * 0.5f;
+        t = t - pipeline_floor(t);
+        p.x[i] = 2 * std::min(t, 1 - t);
+    }
+}
+
+static inline PipelineStageFn unit_tile_stage(GShader::TileMode tm)
+{
+    switch (tm)
+    {
+    case GShader::kRepeat:
+        return stage_repeat_x;
+    case GShader::kMirror:
+        return stage_mirror_x;
+    default:
+        return stage_clamp_x;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// color
+
+struct GradientStopsCtx
+{
+    const GColor *fColors;
+    int fCount;
+};
+
+// r, g, b, a = the (unpremul) color at t = x in [0, 1], for stops evenly spaced over [0, 1]
+static inline void stage_evenly_spaced_stops(PipelineLanes &p, const void *ctx)
+{
+    const GradientStopsCtx &stops = *static_cast<const GradientStopsCtx *>(ctx);
+    const int last = stops.fCount - 1;
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        float fx = p.x[i] * last;
+        int idx = std::min(std::max((int)fx, 0), std::max(last - 1, 0));
+        const GColor &c0 = stops.fColors[idx];
+        const GColor &c1 = stops.fColors[std::min(idx + 1, last)];
+        float w = fx - idx;
+        p.r[i] = c0.r + w * (c1.r - c0.r);
+        p.g[i] = c0.g + w * (c1.g - c0.g);
+        p.b[i] = c0.b + w * (c1.b - c0.b);
+        p.a[i] = c0.a + w * (c1.a - c0.a);
+    }
+}
+
+static inline void stage_premul(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.r[i] *= p.a[i];
+        p.g[i] *= p.a[i];
+        p.b[i] *= p.a[i];
+    }
+}
+
+// r, g, b, a *= ctx (a float: the paint's alpha)
+static inline void stage_scale_alpha(PipelineLanes &p, const void *ctx)
+{
+    const float s = *static_cast<const float *>(ctx);
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        p.r[i] *= s;
+        p.g[i] *= s;
+        p.b[i] *= s;
+        p.a[i] *= s;
+    }
+}
+
+// unpack a premul GPixel into lane i of r, g, b, a
+static inline void pipeline_unpack(GPixel c, int i, float r[], float g[], float b[], float a[])
+{
+    const float k = 1 / 255.0f;
+    r[i] = GPixel_GetR(c) * k;
+    g[i] = GPixel_GetG(c) * k;
+    b[i] = GPixel_GetB(c) * k;
+    a[i] = GPixel_GetA(c) * k;
+}
+
+// unpack all the lanes at once (gather the pixels first, so this part can vectorize)
+static inline void pipeline_unpack_lanes(const GPixel px[], float r[], float g[], float b[], float a[])
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        pipeline_unpack(px[i], i, r, g, b, a);
+    }
+}
+
+// for shaders without stages of their own: shade the lanes with shadeRow() and unpack them.
+// ctx is the GShader
+static inline void stage_shade_row(PipelineLanes &p, const void *ctx)
+{
+    GShader *shader = static_cast<GShader *>(const_cast<void *>(ctx));
+    GPixel row[kPipelineLanes] = {};
+    shader->shadeRow(p.dx, p.dy, p.n, row);
+    pipeline_unpack_lanes(row, p.r, p.g, p.b, p.a);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// dst
+
+static inline void stage_load_dst(PipelineLanes &p, const void *)
+{
+    GPixel px[kPipelineLanes] = {};
+    std::copy(p.dst, p.dst + p.n, px);
+    pipeline_unpack_lanes(px, p.dr, p.dg, p.db, p.da);
+}
+
+/**
+ *  Every GBlendMode is  result = S * Fs + D * Fd  (for all four channels), where the two
+ *  factors only depend on the src and dst alphas:
+ *
+ *      kClear    0         0           kSrcOut   1 - Da    0
+ *      kSrc      1         0           kDstOut   0         1 - Sa
+ *      kDst      0         1           kSrcATop  Da        1 - Sa
+ *      kSrcOver  1         1 - Sa      kDstATop  1 - Da    Sa
+ *      kDstOver  1 - Da    1           kXor      1 - Da    1 - Sa
+ *      kSrcIn    Da        0
+ *      kDstIn    0         Sa
+ */
+enum class BlendFactor
+{
+    kZero,
+    kOne,
+    kSa,
+    kDa,
+    kInvSa,
+    kInvDa,
+};
+
+template <BlendFactor F>
+static inline float blend_factor(float sa, float da)
+{
+    return F == BlendFactor::kZero ? 0 : F == BlendFactor::kOne ? 1 : F == BlendFactor::kSa ? sa : F == BlendFactor::kDa ? da : F == BlendFactor::kInvSa ? 1 - sa : 1 - da;
+}
+
+template <BlendFactor Fs, BlendFactor Fd>
+static inline void stage_blend(PipelineLanes &p, const void *)
+{
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        float fs = blend_factor<Fs>(p.a[i], p.da[i]);
+        float fd = blend_factor<Fd>(p.a[i], p.da[i]);
+        p.r[i] = p.r[i] * fs + p.dr[i] * fd;
+        p.g[i] = p.g[i] * fs + p.dg[i] * fd;
+        p.b[i] = p.b[i] * fs + p.db[i] * fd;
+        p.a[i] = p.a[i] * fs + p.da[i] * fd;
+    }
+}
+
+// indexed by GBlendMode
+static const PipelineStageFn gPipelineBlendStages[] = {
+    stage_blend<BlendFactor::kZero, BlendFactor::kZero>,   // kClear
+    stage_blend<BlendFactor::kOne, BlendFactor::kZero>,    // kSrc
+    stage_blend<BlendFactor::kZero, BlendFactor::kOne>,    // kDst
+    stage_blend<BlendFactor::kOne, BlendFactor::kInvSa>,   // kSrcOver
+    stage_blend<BlendFactor::kInvDa, BlendFactor::kOne>,   // kDstOver
+    stage_blend<BlendFactor::kDa, BlendFactor::kZero>,     // kSrcIn
+    stage_blend<BlendFactor::kZero, BlendFactor::kSa>,     // kDstIn
+    stage_blend<BlendFactor::kInvDa, BlendFactor::kZero>,  // kSrcOut
+    stage_blend<BlendFactor::kZero, BlendFactor::kInvSa>,  // kDstOut
+    stage_blend<BlendFactor::kDa, BlendFactor::kInvSa>,    // kSrcATop
+    stage_blend<BlendFactor::kInvDa, BlendFactor::kSa>,    // kDstATop
+    stage_blend<BlendFactor::kInvDa, BlendFactor::kInvSa>, // kXor
+};
+
+// result = lerp(dst, result, coverage), for partially covered spans
+static inline void stage_lerp_coverage(PipelineLanes &p, const void *)
+{
+    if (p.coverage == nullptr)
+    {
+        return;
+    }
+    const float k = 1 / 255.0f;
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        float c = (i < p.n ? p.coverage[i] : 0) * k;
+        p.r[i] = p.dr[i] + (p.r[i] - p.dr[i]) * c;
+        p.g[i] = p.dg[i] + (p.g[i] - p.dg[i]) * c;
+        p.b[i] = p.db[i] + (p.b[i] - p.db[i]) * c;
+        p.a[i] = p.da[i] + (p.a[i] - p.da[i]) * c;
+    }
+}
+
+static inline uint32_t pipeline_to_byte(float v)
+{
+    return (uint32_t)(int)(std::min(std::max(v, 0.0f), 1.0f) * 255 + 0.5f);
+}
+
+// pack every lane (vectorizes), then copy out the live ones
+static inline void stage_store(PipelineLanes &p, const void *)
+{
+    GPixel px[kPipelineLanes];
+    for (int i = 0; i < kPipelineLanes; i++)
+    {
+        px[i] = (pipeline_to_byte(p.a[i]) << GPIXEL_SHIFT_A) | (pipeline_to_byte(p.r[i]) << GPIXEL_SHIFT_R) |
+                (pipeline_to_byte(p.g[i]) << GPIXEL_SHIFT_G) | (pipeline_to_byte(p.b[i]) << GPIXEL_SHIFT_B);
+    }
+    std::copy(px, px + p.n, p.dst);
+}
+
+#endif
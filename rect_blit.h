@@ -0,0 +1,165 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef rect_blit_DEFINED
+#define rect_blit_DEFINED
+
+#include "GMatrix.h"
+#include "GPath.h"
+#include "GPixel.h"
+#include "GPoint.h"
+#include "GRect.h"
+#include "span_blit.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// helpers for the canvas's axis-aligned rect engine: spotting rects, and filling big ones
+
+// true if the matrix keeps axis-aligned rects axis-aligned (no skew or rotation)
+static inline bool is_scale_translate(const GMatrix &m)
+{
+    return m[GMatrix::KX] == 0 && m[GMatrix::KY] == 0;
+}
+
+// GMatrix::mapRect() for a scale/translate matrix, without mapping all 4 corners
+static inline GRect map_scale_translate(const GMatrix &m, const GRect &r)
+{
+    float l = m[GMatrix::SX] * r.fLeft + m[GMatrix::TX], rt = m[GMatrix::SX] * r.fRight + m[GMatrix::TX];
+    float t = m[GMatrix::SY] * r.fTop + m[GMatrix::TY], b = m[GMatrix::SY] * r.fBottom + m[GMatrix::TY];
+    return GRect::LTRB(std::min(l, rt), std::min(t, b), std::max(l, rt), std::max(t, b));
+}
+
+// the bounds of count (> 0) points
+static inline GRect bounds_of(const GPoint pts[], int count)
+{
+    GRect r = GRect::LTRB(pts[0].fX, pts[0].fY, pts[0].fX, pts[0].fY);
+    for (int i = 1; i < count; i++)
+    {
+        r.fLeft = std::min(r.fLeft, pts[i].fX);
+        r.fTop = std::min(r.fTop, pts[i].fY);
+        r.fRight = std::max(r.fRight, pts[i].fX);
+        r.fBottom = std::max(r.fBottom, pts[i].fY);
+    }
+    return r;
+}
+
+/**
+ *  If the 4 points are the corners of an axis-aligned rect, in order (either direction,
+ *  starting at any corner), stores its bounds in rect and returns true. A rect with no area
+ *  still counts: it just fills nothing.
+ */
+static bool points_are_rect(const GPoint pts[], int count, GRect *rect)
+{
+    if (count != 4)
+    {
+        return false;
+    }
+    // the first edge is vertical and the rest alternate, or the first is horizontal...
+    bool vertFirst = pts[0].fX == pts[1].fX && pts[1].fY == pts[2].fY && pts[2].fX == pts[3].fX &&
+                     pts[3].fY == pts[0].fY;
+    bool horzFirst = pts[0].fY == pts[1].fY && pts[1].fX == pts[2].fX && pts[2].fY == pts[3].fY &&
+                     pts[3].fX == pts[0].fX;
+    if (!vertFirst && !horzFirst)
+    {
+        return false;
+    }
+    *rect = GRect::LTRB(std::min(pts[0].fX, pts[2].fX), std::min(pts[0].fY, pts[2].fY),
+                        std::max(pts[0].fX, pts[2].fX), std::max(pts[0].fY, pts[2].fY));
+    // written so nan fails too
+    return rect->fLeft <= rect->fRight && rect->fTop <= rect->fBottom;
+}
+
+/**
+ *  If the path is one contour of 4 lines (moveTo and 3 lineTo's, plus maybe a 4th lineTo back
+ *  to the start), copies its 4 points into pts and returns true.
+ */
+static bool path_is_quad(const GPath &path, GPoint pts[4])
+{
+    int n = path.countPoints();
+    if (n != 4 && n != 5)
+    {
+        return false;
+    }
+    GPath::Iter iter(path);
+    GPoint p[GPath::kMaxNextPoints];
+    if (iter.next(p) != GPath::kMove)
+    {
+        return false;
+    }
+    pts[0] = p[0];
+    for (int i = 1; i < n; i++)
+    {
+        if (iter.next(p) != GPath::kLine)
+        {
+            return false;
+        }
+        if (i < 4)
+        {
+            pts[i] = p[1];
+        }
+        else if (p[1] != pts[0])
+        {
+            return false;
+        }
+    }
+    return iter.next(p) == GPath::kDone;
+}
+
+// true if every side of the rect is on a pixel boundary, so anti-aliasing covers each pixel
+// inside it fully (and nothing outside)
+static inline bool is_pixel_aligned(const GRect &r)
+{
+    return r.fLeft == std::floor(r.fLeft) && r.fTop == std::floor(r.fTop) &&
+           r.fRight == std::floor(r.fRight) && r.fBottom == std::floor(r.fBottom);
+}
+
+enum
+{
+    // fills at least this big (in bytes) bypass the cache: nothing is going to read them back
+    // before they would have been evicted anyway, and streaming them spares whatever else is
+    // in cache
+    kStreamFillBytes = 2 * 1024 * 1024,
+};
+
+/**
+ *  Sets a width x height block of pixels (rows rowBytes apart) to color with non-temporal
+ *  stores, which write straight to memory instead of pulling every line into the cache first.
+ *  Only worth it past kStreamFillBytes; smaller fills should use std::fill.
+ */
+static void stream_fill_rect(GPixel *dst, size_t rowBytes, int width, int height, GPixel color)
+{
+#ifdef SPAN_BLIT_SSE2
+    const __m128i v = _mm_set1_epi32((int)color);
+    for (int y = 0; y < height; y++)
+    {
+        GPixel *row = (GPixel *)((char *)dst + y * rowBytes);
+        int x = 0;
+        // the streaming store needs 16-byte alignment (pixels are always 4-byte aligned)
+        for (; x < width && ((uintptr_t)(row + x) & 15) != 0; x++)
+        {
+            row[x] = color;
+        }
+        for (; x + 4 <= width; x += 4)
+        {
+            _mm_stream_si128((__m128i *)(row + x), v);
+        }
+        for (; x < width; x++)
+        {
+            row[x] = color;
+        }
+    }
+    // the streamed stores are weakly ordered: make them visible before anything reads dst
+    _mm_sfence();
+#else
+    for (int y = 0; y < height; y++)
+    {
+        GPixel *row = (GPixel *)((char *)dst + y * rowBytes);
+        std::fill(row, row + width, color);
+    }
+#endif
+}
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef scratch_arena_DEFINED
+#define scratch_arena_DEFINED
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ *  A bump allocator for per-draw scratch (edges, coverage rows, mapped points...).
+ *
+ *  make() hands out uninitialized memory from the current block, and reset() takes all of it
+ *  back at once. The blocks are kept: if a draw needed more than one, reset() swaps them for
+ *  a single block of their total size. So after the first few draws every draw fits in one
+ *  block, and rendering stops touching the heap.
+ *
+ *  A draw made of many smaller ones (a batch) can mark() the arena before each part and
+ *  rewind() to it after, so the parts reuse the same scratch instead of piling up.
+ *
+ *  Only for trivially copyable types: nothing is ever destroyed.
+ */
+class ScratchArena
+{
+public:
+    template <typename T>
+    T *make(size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "scratch is never destroyed");
+        return static_cast<T *>(this->alloc(count * sizeof(T)));
+    }
+
+    void reset()
+    {
+        if (fBlocks.size() > 1)
+        {
+            size_t total = 0;
+            for (const Block &b : fBlocks)
+            {
+                total += b.fSize;
+            }
+            fBlocks.clear();
+            this->addBlock(total);
+        }
+        fUsed = 0;
+    }
+
+    // where the arena is up to: everything made after it can be handed back with rewind()
+    struct Mark
+    {
+        size_t fBlocks;
+        size_t fUsed;
+    };
+
+    Mark mark() const
+    {
+        return {fBlocks.size(), fUsed};
+    }
+
+    /**
+     *  Hands back everything made since m, keeping what was made before it. If that needed new
+     *  blocks, the last (biggest) one is kept, empty, for whatever comes next, so a run of
+     *  parts that each overflow the marked block settles into that one instead of allocating
+     *  every time.
+     */
+    void rewind(Mark m)
+    {
+        assert(m.fBlocks <= fBlocks.size());
+        if (fBlocks.size() == m.fBlocks)
+        {
+            assert(m.fUsed <= fUsed);
+            fUsed = m.fUsed;
+            return;
+        }
+        if (fBlocks.size() > m.fBlocks + 1)
+        {
+            fBlocks.erase(fBlocks.begin() + m.fBlocks, fBlocks.end() - 1);
+        }
+        fUsed = 0;
+    }
+
+    // total bytes held (in use or not)
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (const Block &b : fBlocks)
+        {
+            total += b.fSize;
+        }
+        return total;
+    }
+
+    // resets the arena when the draw that owns it returns
+    class AutoReset
+    {
+    public:
+        AutoReset(ScratchArena *arena) : fArena(arena) {}
+        ~AutoReset() { fArena->reset(); }
+
+    private:
+        ScratchArena *fArena;
+    };
+
+private:
+    enum
+    {
+        kAlign = alignof(std::max_align_t),
+        kMinBlockSize = 16 * 1024,
+    };
+
+    struct Block
+    {
+        std::unique_ptr<char[]> fData;
+        size_t fSize;
+    };
+
+    void *alloc(size_t bytes)
+    {
+        bytes = (bytes + kAlign - 1) & ~(size_t)(kAlign - 1);
+        if (fBlocks.empty() || fUsed + bytes > fBlocks.back().fSize)
+        {
+            // the old block's tail is wasted until the next reset()
+            this->addBlock(std::max(bytes, std::max((size_t)kMinBlockSize, this->capacity())));
+        }
+        void *ptr = fBlocks.back().fData.get() + fUsed;
+        fUsed += bytes;
+        return ptr;
+    }
+
+    void addBlock(size_t size)
+    {
+        // new char[] is aligned for any fundamental type
+        Block b;
+        b.fData.reset(new char[size]);
+        b.fSize = size;
+        fBlocks.push_back(std::move(b));
+        fUsed = 0;
+    }
+
+    std::vector<Block> fBlocks;
+    size_t fUsed = 0; // bytes used in the last block
+};
+
+/**
+ *  The bits of std::vector the scan converters use, backed by a ScratchArena. Growing copies
+ *  into a new, twice as big, array from the arena and abandons the old one, so push_back()
+ *  stays amortized O(1) and never frees anything.
+ */
+template <typename T>
+class ScratchArray
+{
+public:
+    explicit ScratchArray(ScratchArena *arena, size_t reserve = 0) : fArena(arena)
+    {
+        this->reserve(reserve);
+    }
+
+    ScratchArray(ScratchArena *arena, size_t count, const T &value) : fArena(arena)
+    {
+        this->reserve(count);
+        std::fill(fData, fData + count, value);
+        fSize = count;
+    }
+
+    ScratchArray(const ScratchArray &) = delete;
+    ScratchArray &operator=(const ScratchArray &) = delete;
+
+    T *data() { return fData; }
+    const T *data() const { return fData; }
+    size_t size() const { return fSize; }
+    bool empty() const { return fSize == 0; }
+
+    T *begin() { return fData; }
+    T *end() { return fData + fSize; }
+    const T *begin() const { return fData; }
+    const T *end() const { return fData + fSize; }
+
+    T &operator[](size_t i)
+    {
+        assert(i < fSize);
+        return fData[i];
+    }
+    const T &operator[](size_t i) const
+    {
+        assert(i < fSize);
+        return fData[i];
+    }
+    T &back()
+    {
+        assert(fSize > 0);
+        return fData[fSize - 1];
+    }
+
+    void push_back(const T &value)
+    {
+        if (fSize == fCapacity)
+        {
+            this->reserve(std::max((size_t)16, fCapacity * 2));
+        }
+        new (fData + fSize) T(value);
+        fSize++;
+    }
+
+    void pop_back()
+    {
+        assert(fSize > 0);
+        fSize--;
+    }
+
+    void append(const T *first, const T *last)
+    {
+        size_t count = last - first;
+        if (fSize + count > fCapacity)
+        {
+            this->reserve(std::max(fSize + count, fCapacity * 2));
+        }
+        std::copy(first, last, fData + fSize);
+        fSize += count;
+    }
+
+    void clear() { fSize = 0; }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity <= fCapacity)
+        {
+            return;
+        }
+        T *data = fArena->make<T>(capacity);
+        if (fSize > 0)
+        {
+            memcpy((void *)data, (const void *)fData, fSize * sizeof(T));
+        }
+        fData = data;
+        fCapacity = capacity;
+    }
+
+private:
+    ScratchArena *fArena;
+    T *fData = nullptr;
+    size_t fSize = 0;
+    size_t fCapacity = 0;
+};
+
+#endif
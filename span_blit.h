@@ -0,0 +1,132 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#ifndef span_blit_DEFINED
+#define span_blit_DEFINED
+
+#include "GPixel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define SPAN_BLIT_SSE2 1
+#endif
+
+#if defined(SPAN_BLIT_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SPAN_BLIT_AVX2 1
+#endif
+
+// blends a constant premul src over count pixels of dst with kSrcOver.
+// every kernel matches srcOver() in claire_utilz.h bit for bit:
+//      div255(v) == ((v + 128) * 257) >> 16   for all v <= 255 * 255
+typedef void (*SrcOverSpanProc)(GPixel dst[], int count, GPixel src);
+
+static inline GPixel srcover_span_pixel(GPixel d, GPixel src, unsigned norm)
+{
+    unsigned a = GPixel_GetA(src) + (((norm * GPixel_GetA(d) + 128) * 257) >> 16);
+    unsigned r = GPixel_GetR(src) + (((norm * GPixel_GetR(d) + 128) * 257) >> 16);
+    unsigned g = GPixel_GetG(src) + (((norm * GPixel_GetG(d) + 128) * 257) >> 16);
+    unsigned b = GPixel_GetB(src) + (((norm * GPixel_GetB(d) + 128) * 257) >> 16);
+    return GPixel_PackARGB(a, r, g, b);
+}
+
+static void srcover_span_scalar(GPixel dst[], int count, GPixel src)
+{
+    unsigned norm = 255 - GPixel_GetA(src);
+    for (int i = 0; i < count; i++)
+    {
+        dst[i] = srcover_span_pixel(dst[i], src, norm);
+    }
+}
+
+#ifdef SPAN_BLIT_SSE2
+// 4 pixels per iteration, each channel widened to 16 bits
+static void srcover_span_sse2(GPixel dst[], int count, GPixel src)
+{
+    unsigned norm = 255 - GPixel_GetA(src);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vnorm = _mm_set1_epi16((short)norm);
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i k257 = _mm_set1_epi16(257);
+    const __m128i vsrc = _mm_set1_epi32((int)src);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = _mm_unpacklo_epi8(d, zero);
+        __m128i hi = _mm_unpackhi_epi8(d, zero);
+        lo = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(lo, vnorm), bias), k257);
+        hi = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(hi, vnorm), bias), k257);
+        __m128i res = _mm_add_epi8(_mm_packus_epi16(lo, hi), vsrc);
+        _mm_storeu_si128((__m128i *)(dst + i), res);
+    }
+    for (; i < count; i++)
+    {
+        dst[i] = srcover_span_pixel(dst[i], src, norm);
+    }
+}
+#endif
+
+#ifdef SPAN_BLIT_AVX2
+// same math as the sse2 kernel, 8 pixels per iteration
+// (unpack and pack both work per 128-bit lane, so pixel order is preserved)
+__attribute__((target("avx2"))) static void srcover_span_avx2(GPixel dst[], int count, GPixel src)
+{
+    unsigned norm = 255 - GPixel_GetA(src);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vnorm = _mm256_set1_epi16((short)norm);
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i k257 = _mm256_set1_epi16(257);
+    const __m256i vsrc = _mm256_set1_epi32((int)src);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = _mm256_unpacklo_epi8(d, zero);
+        __m256i hi = _mm256_unpackhi_epi8(d, zero);
+        lo = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(lo, vnorm), bias), k257);
+        hi = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(hi, vnorm), bias), k257);
+        __m256i res = _mm256_add_epi8(_mm256_packus_epi16(lo, hi), vsrc);
+        _mm256_storeu_si256((__m256i *)(dst + i), res);
+    }
+    // finish the tail here rather than in the sse2 kernel, so we never mix vex and
+    // legacy sse encodings (that transition costs far more than a short span)
+    for (; i < count; i++)
+    {
+        dst[i] = srcover_span_pixel(dst[i], src, norm);
+    }
+}
+#endif
+
+// picks the widest kernel this cpu can run, once
+static SrcOverSpanProc choose_srcover_span()
+{
+#ifdef SPAN_BLIT_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return srcover_span_avx2;
+    }
+#endif
+#ifdef SPAN_BLIT_SSE2
+    return srcover_span_sse2;
+#else
+    return srcover_span_scalar;
+#endif
+}
+
+static inline void srcover_span(GPixel dst[], int count, GPixel src)
+{
+    static const SrcOverSpanProc proc = choose_srcover_span();
+    if (count < 4)
+    {
+        // too short to be worth the indirect call
+        srcover_span_scalar(dst, count, src);
+        return;
+    }
+    proc(dst, count, src);
+}
+
+#endif
@@ -10,15 +10,46 @@ GPath::~GPath() {}
 
 GPath& GPath::operator=(const GPath& src) {
     if (this != &src) {
-        fPts = src.fPts;
-        fVbs = src.fVbs;
+        fData = src.fData;
     }
     return *this;
 }
 
+const GPath::Data& GPath::data() const {
+    static const Data gEmpty;
+    return fData ? *fData : gEmpty;
+}
+
+uint32_t GPath::getGenerationID() const {
+    if (!fData) {
+        return 0;
+    }
+    uint32_t id = fData->fGenID.load(std::memory_order_relaxed);
+    if (id == 0) {
+        static std::atomic<uint32_t> gNextID{1};
+        uint32_t next;
+        do {
+            next = gNextID.fetch_add(1, std::memory_order_relaxed);
+        } while (next == 0);
+        // whoever gets there first wins, so every thread sees the same ID
+        if (!fData->fGenID.compare_exchange_strong(id, next, std::memory_order_relaxed)) {
+            return id;
+        }
+        id = next;
+    }
+    return id;
+}
+
 GPath& GPath::reset() {
-    fPts.clear();
-    fVbs.clear();
+    if (fData && fData.use_count() == 1) {
+        // keep the capacity for whatever gets built next
+        fData->fPts.clear();
+        fData->fVbs.clear();
+        fData->fGenID.store(0, std::memory_order_relaxed);
+        fData->fBoundsState.store(Data::kBoundsUnknown, std::memory_order_relaxed);
+    } else {
+        fData = nullptr;
+    }
     return *this;
 }
 
@@ -48,19 +79,21 @@ void GPath::dump() const {
 }
 
 GPath& GPath::quadTo(GPoint p1, GPoint p2) {
-    assert(fVbs.size() > 0);
-    fPts.push_back(p1);
-    fPts.push_back(p2);
-    fVbs.push_back(kQuad);
+    Data& data = this->edit();
+    assert(data.fVbs.size() > 0);
+    data.fPts.push_back(p1);
+    data.fPts.push_back(p2);
+    data.fVbs.push_back(kQuad);
     return *this;
 }
 
 GPath& GPath::cubicTo(GPoint p1, GPoint p2, GPoint p3) {
-    assert(fVbs.size() > 0);
-    fPts.push_back(p1);
-    fPts.push_back(p2);
-    fPts.push_back(p3);
-    fVbs.push_back(kCubic);
+    Data& data = this->edit();
+    assert(data.fVbs.size() > 0);
+    data.fPts.push_back(p1);
+    data.fPts.push_back(p2);
+    data.fPts.push_back(p3);
+    data.fVbs.push_back(kCubic);
     return *this;
 }
 
@@ -68,9 +101,9 @@ GPath& GPath::cubicTo(GPoint p1, GPoint p2, GPoint p3) {
 
 GPath::Iter::Iter(const GPath& path) {
     fPrevMove = nullptr;
-    fCurrPt = path.fPts.data();
-    fCurrVb = path.fVbs.data();
-    fStopVb = fCurrVb + path.fVbs.size();
+    fCurrPt = path.data().fPts.data();
+    fCurrVb = path.data().fVbs.data();
+    fStopVb = fCurrVb + path.data().fVbs.size();
 }
 
 GPath::Verb GPath::Iter::next(GPoint pts[]) {
@@ -107,13 +140,28 @@ GPath::Verb GPath::Iter::next(GPoint pts[]) {
 
 GPath::Edger::Edger(const GPath& path) {
     fPrevMove = nullptr;
-    fCurrPt = path.fPts.data();
-    fCurrVb = path.fVbs.data();
-    fStopVb = fCurrVb + path.fVbs.size();
+    fCurrPt = path.data().fPts.data();
+    fCurrVb = path.data().fVbs.data();
+    fStopVb = fCurrVb + path.data().fVbs.size();
     fPrevVerb = kDone;
+    fMapPoints = false;
+}
+
+GPath::Edger::Edger(const GPath& path, const GMatrix& matrix) : Edger(path) {
+    fMatrix = matrix;
+    fMapPoints = true;
 }
 
 GPath::Verb GPath::Edger::next(GPoint pts[]) {
+    Verb v = this->nextUnmapped(pts);
+    if (fMapPoints && v != kDone) {
+        // kLine returns 2 points, kQuad 3, kCubic 4
+        fMatrix.mapPoints(pts, pts, (int)v + 1);
+    }
+    return v;
+}
+
+GPath::Verb GPath::Edger::nextUnmapped(GPoint pts[]) {
     assert(fCurrVb <= fStopVb);
     bool do_return = false;
     while (fCurrVb < fStopVb) {
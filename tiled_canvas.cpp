@@ -0,0 +1,478 @@
+/*
+ *  Copyright 2022 <Claire Helms>
+ */
+
+#include "GCanvas.h"
+#include "GBitmap.h"
+#include "GMath.h"
+#include "GMatrix.h"
+#include "GPaint.h"
+#include "GPath.h"
+#include "GPoint.h"
+#include "GRect.h"
+#include "GShader.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// defined in my_canvas.cpp: a canvas that only draws rows [top, bottom) of device
+std::unique_ptr<GCanvas> GCreateBandCanvas(const GBitmap &device, int top, int bottom);
+
+/**
+ *  A small work-stealing thread pool. run(count, fn) calls fn(0) ... fn(count - 1) on the
+ *  workers plus the calling thread, and returns once they have all finished.
+ *
+ *  The tasks are dealt round-robin into one deque per thread. Each thread pops from the front
+ *  of its own deque, and once that is empty it steals from the back of the others, so a thread
+ *  stuck with the expensive tasks gets help instead of holding everyone up.
+ */
+class WorkStealingPool
+{
+public:
+    WorkStealingPool(int threadCount) : fQueues(std::max(threadCount, 1))
+    {
+        // thread 0 is whoever calls run()
+        for (int i = 1; i < (int)fQueues.size(); i++)
+        {
+            fWorkers.emplace_back([this, i]
+                                  { this->workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fQuit = true;
+        }
+        fWake.notify_all();
+        for (std::thread &t : fWorkers)
+        {
+            t.join();
+        }
+    }
+
+    void run(int count, const std::function<void(int)> &fn)
+    {
+        if (count <= 0)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fTask = &fn;
+            fPending = count;
+            fGeneration++;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            Queue &q = fQueues[i % fQueues.size()];
+            std::lock_guard<std::mutex> lock(q.fMutex);
+            q.fTasks.push_back(i);
+        }
+        fWake.notify_all();
+
+        this->work(0);
+
+        std::unique_lock<std::mutex> lock(fMutex);
+        fDone.wait(lock, [this]
+                   { return fPending == 0; });
+        fTask = nullptr;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex fMutex;
+        std::deque<int> fTasks;
+    };
+
+    // own deque first (front), then steal from everyone else (back)
+    bool next(int self, int *task)
+    {
+        int n = (int)fQueues.size();
+        for (int k = 0; k < n; k++)
+        {
+            Queue &q = fQueues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(q.fMutex);
+            if (q.fTasks.empty())
+            {
+                continue;
+            }
+            if (k == 0)
+            {
+                *task = q.fTasks.front();
+                q.fTasks.pop_front();
+            }
+            else
+            {
+                *task = q.fTasks.back();
+                q.fTasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void work(int self)
+    {
+        int task;
+        while (this->next(self, &task))
+        {
+            (*fTask)(task);
+            if (--fPending == 0)
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                fDone.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(int self)
+    {
+        unsigned seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(fMutex);
+                fWake.wait(lock, [&]
+                           { return fQuit || fGeneration != seen; });
+                if (fQuit)
+                {
+                    return;
+                }
+                seen = fGeneration;
+            }
+            this->work(self);
+        }
+    }
+
+    std::vector<Queue> fQueues;
+    std::vector<std::thread> fWorkers;
+    std::mutex fMutex;
+    std::condition_variable fWake;
+    std::condition_variable fDone;
+    const std::function<void(int)> *fTask = nullptr;
+    std::atomic<int> fPending{0};
+    unsigned fGeneration = 0;
+    bool fQuit = false;
+};
+
+/**
+ *  Records every draw (with the CTM it was made under) and bins it into the horizontal bands
+ *  ("tiles") its device bounds touch. flush() then hands the bands to the pool, and each band
+ *  replays its draws, in the order they were made, into a band canvas that only writes its own
+ *  rows.
+ *
+ *  Bands span the full width on purpose: a band canvas steps edges and shaders exactly as the
+ *  serial canvas does and only skips the rows it doesn't own, so the output is byte-identical.
+ *  Edges that start above a band are stepped to its first row rather than scanned there, so a
+ *  tall path costs each band about its own rows, not everything above them too.
+ *
+ *  Each band shades through its own GShader::clone(), so shaded draws run in parallel too.
+ */
+class TiledCanvas : public GCanvas
+{
+public:
+    TiledCanvas(const GBitmap &device, int threadCount) : fDevice(device), fPool(threadCount)
+    {
+        stack.push_back(GMatrix());
+        for (int top = 0; top < device.height(); top += kBandHeight)
+        {
+            int bottom = std::min(top + kBandHeight, device.height());
+            Band band;
+            band.fCanvas = GCreateBandCanvas(device, top, bottom);
+            band.fTop = top;
+            band.fBottom = bottom;
+            fBands.push_back(std::move(band));
+        }
+    }
+
+    ~TiledCanvas() override
+    {
+        this->flush();
+    }
+
+    void save() override
+    {
+        stack.push_back(stack.back());
+    }
+
+    void restore() override
+    {
+        if (stack.size() > 0)
+        {
+            stack.pop_back();
+        }
+        else
+        {
+            throw 505;
+        }
+    }
+
+    void concat(const GMatrix &mx) override
+    {
+        stack.back() = stack.back() * mx;
+    }
+
+    bool quickReject(const GRect &bounds) const override
+    {
+        // same slop as MyCanvas::quickReject
+        GRect dev = stack.back().mapRect(bounds);
+        return dev.fRight < -1 || dev.fBottom < -1 || dev.fLeft > fDevice.width() + 1 ||
+               dev.fTop > fDevice.height() + 1;
+    }
+
+    // what the bands' caches have seen, so only draws that have been flushed
+    CacheStats edgeCacheStats() const override
+    {
+        CacheStats stats;
+        for (const Band &band : fBands)
+        {
+            CacheStats s = band.fCanvas->edgeCacheStats();
+            stats.fHits += s.fHits;
+            stats.fMisses += s.fMisses;
+            stats.fBytes += s.fBytes;
+            stats.fBudget += s.fBudget;
+        }
+        return stats;
+    }
+
+    void drawPaint(const GPaint &paint) override
+    {
+        this->push(Op::kPaint, paint);
+        this->bin(0, fDevice.height());
+    }
+
+    void drawRect(const GRect &rect, const GPaint &paint) override
+    {
+        Op &op = this->push(Op::kRect, paint);
+        op.fRect = rect;
+
+        // MyCanvas::drawRect maps the rect before it rounds it, so bin the unrounded corners
+        GPoint corners[] = {{rect.fLeft, rect.fTop}, {rect.fLeft, rect.fBottom},
+                            {rect.fRight, rect.fBottom}, {rect.fRight, rect.fTop}};
+        stack.back().mapPoints(corners, corners, 4);
+        this->binPoints(corners, 4);
+    }
+
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint &paint) override
+    {
+        if (count < 3)
+        {
+            return;
+        }
+        Op &op = this->push(Op::kPolygon, paint);
+        op.fPts.assign(pts, pts + count);
+
+        std::vector<GPoint> mapped(count);
+        stack.back().mapPoints(mapped.data(), pts, count);
+        this->binPoints(mapped.data(), count);
+    }
+
+    void drawPath(const GPath &path, const GPaint &paint) override
+    {
+        if (path.countPoints() < 3 || this->quickReject(path.bounds()))
+        {
+            return;
+        }
+        Op &op = this->push(Op::kPath, paint);
+        op.fPath = path;
+
+        // curves stay inside their control points, so those bound the whole path. without
+        // rotation or skew, the bounds' corners land exactly where the points' extremes do
+        const GMatrix &ctm = stack.back();
+        if (ctm[GMatrix::KX] == 0 && ctm[GMatrix::KY] == 0)
+        {
+            GRect r = path.bounds();
+            GPoint corners[] = {{r.fLeft, r.fTop}, {r.fRight, r.fBottom}};
+            ctm.mapPoints(corners, corners, 2);
+            this->binPoints(corners, 2);
+            return;
+        }
+        std::vector<GPoint> mapped;
+        GPath::Iter iter(path);
+        GPoint pts[GPath::kMaxNextPoints];
+        GPath::Verb v;
+        while ((v = iter.next(pts)) != GPath::kDone)
+        {
+            int n = v == GPath::kMove ? 1 : (v == GPath::kLine ? 2 : (v == GPath::kQuad ? 3 : 4));
+            mapped.insert(mapped.end(), pts, pts + n);
+        }
+        stack.back().mapPoints(mapped.data(), mapped.data(), (int)mapped.size());
+        this->binPoints(mapped.data(), (int)mapped.size());
+    }
+
+    void flush() override
+    {
+        if (fOps.empty())
+        {
+            return;
+        }
+        fPool.run((int)fBands.size(), [this](int i)
+                  { this->replay(fBands[i]); });
+        fOps.clear();
+        for (Band &band : fBands)
+        {
+            band.fOps.clear();
+            band.fShaders.clear();
+        }
+    }
+
+private:
+    // rows per band: small enough that there are plenty of bands to steal, big enough that
+    // a band's share of each draw isn't dominated by per-draw setup
+    enum
+    {
+        kBandHeight = 32
+    };
+
+    struct Op
+    {
+        enum Kind
+        {
+            kPaint,
+            kRect,
+            kPolygon,
+            kPath,
+        };
+        Kind fKind;
+        GMatrix fCTM;
+        GPaint fPaint;
+        GRect fRect;
+        std::vector<GPoint> fPts;
+        GPath fPath;
+    };
+
+    struct Band
+    {
+        std::unique_ptr<GCanvas> fCanvas;
+        int fTop;
+        int fBottom;
+        std::vector<int> fOps; // indices into fOps, in draw order
+        // the band's own clone of each shader it has drawn with this flush (null if the
+        // shader can't be cloned)
+        std::unordered_map<GShader *, std::unique_ptr<GShader>> fShaders;
+    };
+
+    Op &push(Op::Kind kind, const GPaint &paint)
+    {
+        fOps.emplace_back();
+        Op &op = fOps.back();
+        op.fKind = kind;
+        op.fCTM = stack.back();
+        op.fPaint = paint;
+        return op;
+    }
+
+    // adds the op (the last one pushed) to every band that overlaps rows [top, bottom)
+    void bin(int top, int bottom)
+    {
+        int index = (int)fOps.size() - 1;
+        for (Band &band : fBands)
+        {
+            if (band.fTop < bottom && top < band.fBottom)
+            {
+                band.fOps.push_back(index);
+            }
+        }
+    }
+
+    // bins by the y extent of device space points. edges round to the nearest row and AA
+    // coverage reaches from floor to ceil, so pad a row on either side
+    void binPoints(const GPoint pts[], int count)
+    {
+        float minY = pts[0].fY;
+        float maxY = pts[0].fY;
+        for (int i = 1; i < count; i++)
+        {
+            minY = std::min(minY, pts[i].fY);
+            maxY = std::max(maxY, pts[i].fY);
+        }
+        float h = (float)fDevice.height();
+        if (!(minY <= maxY))
+        {
+            // nan: can't say where it lands, so let every band look at it
+            this->bin(0, fDevice.height());
+            return;
+        }
+        minY = std::max(minY, -1.0f);
+        maxY = std::min(maxY, h + 1);
+        this->bin(GFloorToInt(minY) - 1, GCeilToInt(maxY) + 1);
+    }
+
+    void replay(Band &band)
+    {
+        GCanvas *canvas = band.fCanvas.get();
+        for (int i : band.fOps)
+        {
+            const Op &op = fOps[i];
+
+            // shaders keep their context in the shader object itself, so each band draws
+            // with its own clone. one that can't be cloned is shared, one band at a time
+            GPaint paint = op.fPaint;
+            std::unique_lock<std::mutex> lock(fShaderMutex, std::defer_lock);
+            if (GShader *shader = op.fPaint.getShader())
+            {
+                auto found = band.fShaders.find(shader);
+                if (found == band.fShaders.end())
+                {
+                    found = band.fShaders.emplace(shader, shader->clone()).first;
+                }
+                if (found->second != nullptr)
+                {
+                    paint.setShader(found->second.get());
+                }
+                else
+                {
+                    lock.lock();
+                }
+            }
+
+            canvas->save();
+            canvas->concat(op.fCTM);
+            switch (op.fKind)
+            {
+            case Op::kPaint:
+                canvas->drawPaint(paint);
+                break;
+            case Op::kRect:
+                canvas->drawRect(op.fRect, paint);
+                break;
+            case Op::kPolygon:
+                canvas->drawConvexPolygon(op.fPts.data(), (int)op.fPts.size(), paint);
+                break;
+            case Op::kPath:
+                canvas->drawPath(op.fPath, paint);
+                break;
+            }
+            canvas->restore();
+        }
+    }
+
+    const GBitmap fDevice;
+    std::vector<GMatrix> stack;
+    std::vector<Op> fOps;
+    std::vector<Band> fBands;
+    std::mutex fShaderMutex;
+    WorkStealingPool fPool;
+};
+
+std::unique_ptr<GCanvas> GCreateTiledCanvas(const GBitmap &device, int threadCount)
+{
+    if (device.pixels() == nullptr || device.width() <= 0 || device.height() <= 0)
+    {
+        return nullptr;
+    }
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    return std::unique_ptr<GCanvas>(new TiledCanvas(device, threadCount));
+}